@@ -0,0 +1,7 @@
+// Per-frame data shared by every program, mirrored by FrameData in src/FrameData.h
+layout (std140) uniform FrameData
+{
+	vec4 tint;
+	vec2 resolution;
+	float time;
+};
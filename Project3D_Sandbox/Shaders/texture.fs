@@ -5,11 +5,18 @@ out vec4 FragColor;
 in vec3 ourColor;
 in vec2 texCoord;
 
+#ifdef TEXTURE_ARRAY
+flat in float layer;
+uniform sampler2DArray textureArray;
+#else
 uniform sampler2D texture1;
 uniform sampler2D texture2;
+#endif
 
 uniform float opacity;
 
+#include "frame_data.glsl"
+
 void main()
 {
 	// Permet de tester les coordonnes de la textures. Et donc de les debugguer si besoin
@@ -26,5 +33,14 @@ void main()
 	//FragColor = texture(texture2, texCoord);
 
 	// Affiche les 2 textures mlanges
+#if defined(TEXTURE_ARRAY)
+	// Variante tableau de textures : l'instance choisit sa couche
+	FragColor = texture(textureArray, vec3(texCoord, layer));
+#elif defined(NO_TEXTURE2)
+	// Variante sans la seconde texture, quand elle est totalement transparente
+	FragColor = texture(texture1, texCoord);
+#else
 	FragColor = mix(texture(texture1, texCoord), texture(texture2, texCoord), opacity);
+#endif
+	FragColor *= tint;
 }
\ No newline at end of file
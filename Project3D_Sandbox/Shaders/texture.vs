@@ -1,14 +1,36 @@
 #version 330 core
+#ifdef SEPARABLE_PROGRAM
+#extension GL_ARB_separate_shader_objects : enable
+#endif
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
+#ifdef TEXTURE_ARRAY
+layout (location = 3) in vec4 aInstance;		// Per instance : xy offset, z scale, w layer of the texture array
+#endif
 
 out vec3 ourColor;
 out vec2 texCoord;
+#ifdef TEXTURE_ARRAY
+flat out float layer;
+#endif
+
+#ifdef SEPARABLE_PROGRAM
+// A separable vertex stage has to redeclare the built-in outputs it writes
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+#endif
 
 void main()
 {
+#ifdef TEXTURE_ARRAY
+	gl_Position = vec4(aPos * aInstance.z + vec3(aInstance.xy, 0.0), 1.0);
+	layer = aInstance.w;
+#else
 	gl_Position = vec4(aPos, 1.0);
+#endif
 	ourColor = aColor;
 	texCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
\ No newline at end of file
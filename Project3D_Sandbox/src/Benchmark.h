@@ -0,0 +1,1006 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include "BlockCompressor.h"
+#include "FileSystem.h"
+#include "FrameStats.h"
+#include "JpegDecoder.h"
+#include "MipGenerator.h"
+#include "PixelUnpackRing.h"
+#include "PngDecoder.h"
+#include "Shader.h"
+#include "ShaderLibrary.h"
+#include "ShaderPipeline.h"
+#include "TextureArray.h"
+#include "TextureAtlas.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "UploadScheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Micro benchmarks run with "--bench <name> [input]" once a GL context is current */
+namespace Benchmark
+{
+	/* Per-frame cost of setting uniforms by name through the driver vs through the reflected table,
+	   then the gain of the CPU shadow that only uploads what changed by flush() */
+	inline void uniformLookup(int frames = 200, int setsPerFrame = 5000)
+	{
+		Shader shader("./Shaders/texture.vs", "./Shaders/texture.fs");
+		shader.use();
+
+		static constexpr UniformName names[] = { UniformName("opacity"), UniformName("texture1"), UniformName("texture2") };
+		const int nameCount = sizeof(names) / sizeof(names[0]);
+
+		// Before : glGetUniformLocation on every call
+		glFinish();
+		Timer timer;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < setsPerFrame; i++)
+			{
+				const char* name = names[i % nameCount].str;
+				if (i % nameCount == 0)
+				{
+					glUniform1f(glGetUniformLocation(shader.ID, name), (float)(i & 1));
+				}
+				else
+				{
+					glUniform1i(glGetUniformLocation(shader.ID, name), i & 1);
+				}
+			}
+			glFinish();
+		}
+		double driverMs = timer.elapsedMs() / frames;
+
+		// After : location taken from the table built at link time, still one upload per call
+		timer.reset();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < setsPerFrame; i++)
+			{
+				GLint location = shader.getLocation(names[i % nameCount]);
+				if (i % nameCount == 0)
+				{
+					glUniform1f(location, (float)(i & 1));
+				}
+				else
+				{
+					glUniform1i(location, i & 1);
+				}
+			}
+			glFinish();
+		}
+		double tableMs = timer.elapsedMs() / frames;
+
+		// Shadowed : same lookups, but only the values still changed at flush() reach the driver
+		timer.reset();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < setsPerFrame; i++)
+			{
+				const UniformName& name = names[i % nameCount];
+				if (i % nameCount == 0)
+				{
+					shader.setFloat(name, (float)(i & 1));
+				}
+				else
+				{
+					shader.setInt(name, i & 1);
+				}
+			}
+			shader.flush();
+			glFinish();
+		}
+		double shadowedMs = timer.elapsedMs() / frames;
+
+		// Typed handles : resolved once, no lookup at all in the loop
+		Uniform<float> opacity = shader.uniform<float>(names[0]);
+		Uniform<int> texture1 = shader.uniform<int>(names[1]);
+		Uniform<int> texture2 = shader.uniform<int>(names[2]);
+		timer.reset();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < setsPerFrame; i++)
+			{
+				switch (i % nameCount)
+				{
+				case 0: shader.set(opacity, (float)(i & 1)); break;
+				case 1: shader.set(texture1, i & 1); break;
+				default: shader.set(texture2, i & 1); break;
+				}
+			}
+			shader.flush();
+			glFinish();
+		}
+		double handleMs = timer.elapsedMs() / frames;
+
+		printf("BENCH::UNIFORM_LOOKUP %d sets/frame : glGetUniformLocation %.3f ms/frame, reflected table %.3f ms/frame\n",
+			setsPerFrame, driverMs, tableMs);
+		printf("BENCH::UNIFORM_SHADOW %d sets/frame : uploaded per set %.3f ms/frame, shadowed setters %.3f ms/frame, typed handles %.3f ms/frame (uploads %llu, avoided %llu)\n",
+			setsPerFrame, tableMs, shadowedMs, handleMs, shader.uniformStats.uploads, shader.uniformStats.avoided);
+	}
+
+	/* Startup cost of a program compiled from source vs loaded from the binary cache */
+	inline void programBinaryCache()
+	{
+		ProgramBinaryCache cache("./ShaderCache");
+		if (!cache.isEnabled())
+		{
+			printf("BENCH::PROGRAM_BINARY_CACHE program binaries not supported by this driver\n");
+			return;
+		}
+
+		Shader compiled("./Shaders/texture.vs", "./Shaders/texture.fs");
+		Shader first("./Shaders/texture.vs", "./Shaders/texture.fs", &cache);		// Populates the cache on the first run
+		Shader cached("./Shaders/texture.vs", "./Shaders/texture.fs", &cache);
+
+		printf("BENCH::PROGRAM_BINARY_CACHE source compile %.3f ms, first cached build %.3f ms (%s), binary load %.3f ms (%s)\n",
+			compiled.buildMs, first.buildMs, first.fromBinaryCache ? "hit" : "miss",
+			cached.buildMs, cached.fromBinaryCache ? "hit" : "miss");
+
+		glDeleteProgram(compiled.ID);
+		glDeleteProgram(first.ID);
+		glDeleteProgram(cached.ID);
+	}
+
+	/* Build count distinct programs one at a time, then as one ShaderLibrary batch.
+	   A comment with a unique tag makes every source different so the driver's own cache can't help. */
+	inline void shaderBatch(int count = 64)
+	{
+		ShaderSource vertexCode, fragmentCode;
+		Shader::readSources("./Shaders/texture.vs", "./Shaders/texture.fs", vertexCode, fragmentCode);
+
+		char tag[64];
+		unsigned int seed = (unsigned int)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+		Timer timer;
+		for (int i = 0; i < count; i++)
+		{
+			snprintf(tag, sizeof(tag), "\n// serial %u %d\n", seed, i);
+			unsigned int program = glCreateProgram();
+			ShaderSource vertexVariant(vertexCode), fragmentVariant(fragmentCode);
+			vertexVariant.append(SourceFile::text(tag));
+			fragmentVariant.append(SourceFile::text(tag));
+
+			unsigned int vertex = Shader::compileStage(GL_VERTEX_SHADER, vertexVariant);
+			Shader::checkCompile(vertex, "VERTEX");
+			unsigned int fragment = Shader::compileStage(GL_FRAGMENT_SHADER, fragmentVariant);
+			Shader::checkCompile(fragment, "FRAGMENT");
+			glAttachShader(program, vertex);
+			glAttachShader(program, fragment);
+			glLinkProgram(program);
+			Shader::checkLink(program);
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+			glDeleteProgram(program);
+		}
+		double serialMs = timer.elapsedMs();
+
+		ShaderLibrary library;
+		for (int i = 0; i < count; i++)
+		{
+			snprintf(tag, sizeof(tag), "\n// batch %u %d\n", seed, i);
+			ShaderSource vertexVariant(vertexCode), fragmentVariant(fragmentCode);
+			vertexVariant.append(SourceFile::text(tag));
+			fragmentVariant.append(SourceFile::text(tag));
+			library.addSource(std::to_string(i), vertexVariant, fragmentVariant);
+		}
+		library.build();
+		for (int i = 0; i < count; i++)
+		{
+			glDeleteProgram(library.get(std::to_string(i))->ID);
+		}
+
+		printf("BENCH::SHADER_BATCH %d programs : serial %.3f ms, batched %.3f ms (parallel compile %s)\n",
+			count, serialMs, library.buildMs, GLExtensions::get().parallelShaderCompile ? "on" : "off");
+	}
+
+	/* Bind every pair of vertexCount x fragmentCount distinct stages, with separable programs then monolithic ones.
+	   Reports the link count and the time until every pair is ready to draw. */
+	inline void pipelines(int vertexCount = 16, int fragmentCount = 16)
+	{
+		char tag[64];
+		unsigned int seed = (unsigned int)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			bool allowSeparable = pass == 0;
+			ShaderPipelines pipelines(allowSeparable);
+			if (allowSeparable && !pipelines.isSeparable())
+			{
+				printf("BENCH::PIPELINES separate shader objects not supported by this driver\n");
+				continue;
+			}
+
+			std::vector<std::string> defines;
+			if (pipelines.isSeparable())
+			{
+				defines.push_back("SEPARABLE_PROGRAM");
+			}
+			ShaderSource vertexCode, fragmentCode;
+			Shader::readSources("./Shaders/texture.vs", "./Shaders/texture.fs", vertexCode, fragmentCode, defines);
+
+			glFinish();
+			Timer timer;
+			std::vector<int> vertexStages, fragmentStages;
+			for (int i = 0; i < vertexCount; i++)
+			{
+				snprintf(tag, sizeof(tag), "\n// vertex %u %d %d\n", seed, pass, i);
+				ShaderSource variant(vertexCode);
+				variant.append(SourceFile::text(tag));
+				vertexStages.push_back(pipelines.sourceStage(GL_VERTEX_SHADER, tag, variant));
+			}
+			for (int i = 0; i < fragmentCount; i++)
+			{
+				snprintf(tag, sizeof(tag), "\n// fragment %u %d %d\n", seed, pass, i);
+				ShaderSource variant(fragmentCode);
+				variant.append(SourceFile::text(tag));
+				fragmentStages.push_back(pipelines.sourceStage(GL_FRAGMENT_SHADER, tag, variant));
+			}
+			for (int v = 0; v < vertexCount; v++)
+			{
+				for (int f = 0; f < fragmentCount; f++)
+				{
+					ShaderPipelines::Binding binding = pipelines.bind(vertexStages[v], fragmentStages[f]);
+					binding.setFloat("opacity", 0.5f);
+					pipelines.flush(binding);
+				}
+			}
+			glFinish();
+			double totalMs = timer.elapsedMs();
+			pipelines.unbind();
+
+			printf("BENCH::PIPELINES %dx%d %s : %u compiles, %u links, %u pairs, %.3f ms\n",
+				vertexCount, fragmentCount, pipelines.isSeparable() ? "separable" : "monolithic",
+				pipelines.stageCompiles, pipelines.links, pipelines.pairsCreated, totalMs);
+		}
+		glUseProgram(0);
+	}
+
+	/* Update count size x size RGBA textures from client memory, then through the staging ring.
+	   Reports throughput and the worst CPU time of a single upload call, which is what shows up as a frame hitch. */
+	inline void textureUpload(int count = 64, int size = 1024)
+	{
+		size_t imageSize = (size_t)size * size * 4;
+		std::vector<unsigned char> pixels(imageSize);
+		for (size_t i = 0; i < imageSize; i++)
+		{
+			pixels[i] = (unsigned char)(i * 31);
+		}
+
+		std::vector<GLuint> textures(count);
+		glGenTextures(count, textures.data());
+		for (int i = 0; i < count; i++)
+		{
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		glFinish();
+
+		// Before : glTexSubImage2D from client memory
+		double directWorstMs = 0.0;
+		Timer timer;
+		for (int i = 0; i < count; i++)
+		{
+			Timer call;
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			directWorstMs = std::max(directWorstMs, call.elapsedMs());
+		}
+		glFinish();
+		double directMs = timer.elapsedMs();
+
+		// After : staged through the pixel unpack ring, retrying when every slot is busy like a frame loop would
+		PixelUnpackRing ring(4, imageSize);
+		double ringWorstMs = 0.0;
+		timer.reset();
+		for (int i = 0; i < count; i++)
+		{
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			for (;;)
+			{
+				Timer call;
+				bool staged = ring.upload(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data(), imageSize);
+				ringWorstMs = std::max(ringWorstMs, call.elapsedMs());
+				if (staged)
+				{
+					break;
+				}
+			}
+		}
+		glFinish();
+		double ringMs = timer.elapsedMs();
+
+		double megabytes = count * imageSize / (1024.0 * 1024.0);
+		printf("BENCH::TEXTURE_UPLOAD %d x %dx%d RGBA : client memory %.1f MB/s (worst call %.3f ms), staging ring %.1f MB/s (worst call %.3f ms, %u stalls, copy %.1f MB/s)\n",
+			count, size, size, megabytes / (directMs / 1000.0), directWorstMs,
+			megabytes / (ringMs / 1000.0), ringWorstMs, ring.stalls, ring.throughput());
+
+		glDeleteTextures(count, textures.data());
+	}
+
+	/* Stream count size x size RGBA textures while simulating frames, all at once then under the scheduler budget.
+	   A frame is the uploads plus a glFinish, so the GPU side of the copies is counted too. */
+	inline void uploadStreaming(int count = 32, int size = 1024, double budgetMs = 2.0)
+	{
+		size_t imageSize = (size_t)size * size * 4;
+		std::vector<unsigned char> pixels(imageSize);
+		for (size_t i = 0; i < imageSize; i++)
+		{
+			pixels[i] = (unsigned char)(i * 17);
+		}
+
+		std::vector<GLuint> textures(count);
+		glGenTextures(count, textures.data());
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			bool budgeted = pass == 1;
+			PixelUnpackRing staging(8, 512 << 10);
+			UploadScheduler uploads(staging, 0, budgeted ? budgetMs : 0.0, budgeted ? (512 << 10) : imageSize);
+			for (int i = 0; i < count; i++)
+			{
+				uploads.texture(textures[i], 0, GL_RGBA8, size, size, GL_RGBA, GL_UNSIGNED_BYTE, 4, pixels.data());
+			}
+
+			FrameStats frames;
+			glFinish();
+			while (uploads.pending() > 0)
+			{
+				Timer frame;
+				uploads.update();
+				glFinish();
+				frames.add(frame.elapsedMs());
+			}
+
+			printf("BENCH::UPLOAD_STREAMING %d x %dx%d %s : %u frames, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+				count, size, size, budgeted ? "budgeted" : "unbudgeted", (unsigned int)frames.size(),
+				frames.percentile(50.0), frames.percentile(99.0), frames.max());
+		}
+
+		glDeleteTextures(count, textures.data());
+	}
+
+	/* Full mip chain of a size x size RGBA image : scalar reference, SIMD box on one thread then on the pool,
+	   and the Kaiser filter in linear space with alpha weighting. CPU only, the GL context is not used. */
+	inline void mipmaps(int size = 2048, int repeats = 5)
+	{
+		size_t imageSize = (size_t)size * size * 4;
+		std::vector<unsigned char> pixels(imageSize);
+		for (size_t i = 0; i < imageSize; i++)
+		{
+			pixels[i] = (unsigned char)(i * 13 + i / 4096);
+		}
+
+		std::vector<unsigned char> chain;
+		std::vector<MipLevel> levels;
+		MipGenerator single;
+		single.generate(pixels.data(), size, size, 4, MipOptions(), chain, levels);
+		double megabytes = chain.size() / (1024.0 * 1024.0);
+
+		// Before : the 2x2 average one channel at a time, as the cooker used to do it
+		std::vector<unsigned char> reference(chain.size());
+		memcpy(reference.data(), pixels.data(), imageSize);
+		Timer timer;
+		for (int r = 0; r < repeats; r++)
+		{
+			for (size_t level = 1; level < levels.size(); level++)
+			{
+				MipGenerator::downsampleScalar(reference.data() + levels[level - 1].offset, levels[level - 1].width, levels[level - 1].height,
+					4, reference.data() + levels[level].offset);
+			}
+		}
+		double scalarMs = timer.elapsedMs() / repeats;
+
+		ThreadPool pool;
+		MipGenerator threaded(&pool);
+		MipOptions quality;
+		quality.filter = MIP_FILTER_KAISER;
+		quality.srgb = true;
+		quality.alphaWeighted = true;
+
+		double simdMs = 0.0, threadedMs = 0.0, qualityMs = 0.0;
+		for (int r = 0; r < repeats; r++)
+		{
+			timer.reset();
+			single.generate(pixels.data(), size, size, 4, MipOptions(), chain, levels);
+			simdMs += timer.elapsedMs();
+
+			timer.reset();
+			threaded.generate(pixels.data(), size, size, 4, MipOptions(), chain, levels);
+			threadedMs += timer.elapsedMs();
+
+			timer.reset();
+			threaded.generate(pixels.data(), size, size, 4, quality, chain, levels);
+			qualityMs += timer.elapsedMs();
+		}
+		simdMs /= repeats;
+		threadedMs /= repeats;
+		qualityMs /= repeats;
+
+		threaded.generate(pixels.data(), size, size, 4, MipOptions(), chain, levels);
+		bool identical = chain == reference;
+
+		printf("BENCH::MIPMAPS %dx%d RGBA, %u levels : scalar %.2f ms (%.1f MB/s), SIMD box%s %.2f ms (%.1f MB/s), "
+			"%u threads %.2f ms (%.1f MB/s), Kaiser sRGB alpha weighted %.2f ms (%.1f MB/s), box matches scalar : %s\n",
+			size, size, (unsigned int)levels.size(), scalarMs, megabytes / (scalarMs / 1000.0),
+			Simd::hasAVX2() ? " AVX2" : " SSE2", simdMs, megabytes / (simdMs / 1000.0),
+			pool.size() + 1, threadedMs, megabytes / (threadedMs / 1000.0), qualityMs, megabytes / (qualityMs / 1000.0),
+			identical ? "yes" : "NO");
+	}
+
+	/* Compress a size x size RGBA image to each block format, on one thread then on the pool.
+	   Reports the encode throughput in source MB/s and the memory saved. CPU only. */
+	inline void blockCompression(int size = 2048, int repeats = 5)
+	{
+		size_t imageSize = (size_t)size * size * 4;
+		std::vector<unsigned char> pixels(imageSize);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				unsigned char* texel = &pixels[((size_t)y * size + x) * 4];
+				texel[0] = (unsigned char)x;
+				texel[1] = (unsigned char)(x + y);
+				texel[2] = (unsigned char)(y * 3 + (x & 15));
+				texel[3] = (unsigned char)(255 - y);
+			}
+		}
+
+		ThreadPool pool;
+		BlockCompressor single;
+		BlockCompressor threaded(&pool);
+		std::vector<unsigned char> blocks;
+		double megabytes = imageSize / (1024.0 * 1024.0);
+		for (int format = BLOCK_FORMAT_BC1; format <= BLOCK_FORMAT_BC7; format++)
+		{
+			double singleMs = 0.0, threadedMs = 0.0;
+			for (int r = 0; r < repeats; r++)
+			{
+				Timer timer;
+				single.compress(pixels.data(), size, size, 4, (BlockFormat)format, blocks);
+				singleMs += timer.elapsedMs();
+
+				timer.reset();
+				threaded.compress(pixels.data(), size, size, 4, (BlockFormat)format, blocks);
+				threadedMs += timer.elapsedMs();
+			}
+			singleMs /= repeats;
+			threadedMs /= repeats;
+
+			printf("BENCH::BLOCK_COMPRESSION %dx%d RGBA to %s : %.2f MB -> %.2f MB (%.1fx smaller), 1 thread %.2f ms (%.1f MB/s), %u threads %.2f ms (%.1f MB/s)\n",
+				size, size, BlockCompressor::name((BlockFormat)format), megabytes, blocks.size() / (1024.0 * 1024.0),
+				(double)imageSize / blocks.size(), singleMs, megabytes / (singleMs / 1000.0),
+				pool.size() + 1, threadedMs, megabytes / (threadedMs / 1000.0));
+		}
+	}
+
+	/* Cell i of the smallest square grid holding count cells over the viewport */
+	inline void gridCell(int i, int count, float& left, float& bottom, float& size)
+	{
+		int columns = 1;
+		while (columns * columns < count)
+		{
+			columns++;
+		}
+		size = 2.0f / columns;
+		left = -1.0f + (i % columns) * size;
+		bottom = -1.0f + (i / columns) * size;
+	}
+
+	/* One textured quad per grid cell, laid out like the rectangle of main.cpp : position, color, texture coordinates */
+	inline void gridQuads(int count, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+	{
+		const float corners[4][2] = { { 1.0f, 1.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 1.0f } };
+		const unsigned int quad[6] = { 0, 1, 3, 1, 2, 3 };
+		for (int i = 0; i < count; i++)
+		{
+			float left, bottom, size;
+			gridCell(i, count, left, bottom, size);
+			for (int c = 0; c < 4; c++)
+			{
+				float vertex[8] = { left + corners[c][0] * size, bottom + corners[c][1] * size, 0.0f, 1.0f, 1.0f, 1.0f, corners[c][0], corners[c][1] };
+				vertices.insert(vertices.end(), vertex, vertex + 8);
+			}
+			for (int k = 0; k < 6; k++)
+			{
+				indices.push_back((unsigned int)(4 * i) + quad[k]);
+			}
+		}
+	}
+
+	/* count sprites of random small sizes drawn in a grid : one texture each with a bind and a draw per sprite,
+	   then packed in an atlas and drawn with one bind and one draw. Reports the CPU time of a frame. */
+	inline void textureAtlas(int count = 1024, int frames = 100)
+	{
+		std::vector<std::string> defines(1, "NO_TEXTURE2");
+		Shader shader("./Shaders/texture.vs", "./Shaders/texture.fs", defines);
+		shader.setInt("texture1", 0);
+		shader.use();
+
+		// Sprites with their own textures, and the same images in an atlas
+		TextureAtlas atlas(2048, 4);
+		std::vector<GLuint> textures(count);
+		glGenTextures(count, textures.data());
+		unsigned int seed = 12345;
+		for (int i = 0; i < count; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			int width = 8 + (int)(seed >> 16) % 57;
+			int height = 8 + (int)(seed >> 8) % 57;
+			std::vector<unsigned char> pixels((size_t)width * height * 4, (unsigned char)(i * 37));
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			atlas.add(pixels.data(), width, height, 4);
+		}
+		atlas.build();
+
+		PixelUnpackRing staging(2, 4 << 20);
+		UploadScheduler uploads(staging, 0, 0.0, 64 << 20);
+		TextureOptions options;
+		options.mipmaps = false;
+		atlas.upload(uploads, options);
+		while (uploads.pending() > 0)
+		{
+			uploads.update();
+		}
+
+		// One quad per sprite in a grid, then a copy with texture coordinates remapped into the atlas and sorted by page
+		std::vector<float> vertices, remapped;
+		std::vector<unsigned int> indices;
+		gridQuads(count, vertices, indices);
+		std::vector<int> pageFirst(atlas.pageCount() + 1, 0);
+		for (unsigned int page = 0; page < atlas.pageCount(); page++)
+		{
+			pageFirst[page] = (int)remapped.size() / 32;
+			for (int i = 0; i < count; i++)
+			{
+				if (atlas.rect(i).page == page)
+				{
+					size_t first = remapped.size();
+					remapped.insert(remapped.end(), vertices.begin() + (size_t)i * 32, vertices.begin() + (size_t)(i + 1) * 32);
+					TextureAtlas::remap(&remapped[first], 4, 8, 6, atlas.rect(i));
+				}
+			}
+		}
+		pageFirst[atlas.pageCount()] = count;
+
+		GLuint vao, buffers[3];
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(3, buffers);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+		glBufferData(GL_ARRAY_BUFFER, remapped.size() * sizeof(float), remapped.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		auto attributes = [](GLuint buffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+		};
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glActiveTexture(GL_TEXTURE0);
+
+		// Before : a bind and a draw per sprite
+		attributes(buffers[0]);
+		FrameStats separate;
+		glFinish();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Timer timer;
+			for (int i = 0; i < count; i++)
+			{
+				glBindTexture(GL_TEXTURE_2D, textures[i]);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(i * 6 * sizeof(unsigned int)));
+			}
+			glFinish();
+			separate.add(timer.elapsedMs());
+		}
+
+		// After : one bind and one draw per atlas page
+		attributes(buffers[1]);
+		FrameStats batched;
+		glFinish();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Timer timer;
+			for (unsigned int page = 0; page < atlas.pageCount(); page++)
+			{
+				glBindTexture(GL_TEXTURE_2D, atlas.texture(page));
+				glDrawElements(GL_TRIANGLES, (pageFirst[page + 1] - pageFirst[page]) * 6, GL_UNSIGNED_INT,
+					(void*)(pageFirst[page] * 6 * sizeof(unsigned int)));
+			}
+			glFinish();
+			batched.add(timer.elapsedMs());
+		}
+
+		printf("BENCH::ATLAS %d sprites : %d binds and draws p50 %.3f ms, atlas of %u pages (%.0f%% used) p50 %.3f ms\n",
+			count, count, separate.percentile(50.0), (unsigned int)atlas.pageCount(), atlas.getOccupancy() * 100.0f, batched.percentile(50.0));
+
+		glBindVertexArray(0);
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(3, buffers);
+		glDeleteTextures(count, textures.data());
+		glUseProgram(0);
+	}
+
+	/* count objects sharing imageCount same size textures : a bind and a draw per object with GL_TEXTURE_2D,
+	   then one instanced draw reading the layer of each object from a GL_TEXTURE_2D_ARRAY. */
+	inline void textureArray(int count = 1024, int imageCount = 64, int size = 128, int frames = 100)
+	{
+		// Same images both ways
+		std::vector<std::vector<unsigned char>> images(imageCount);
+		std::vector<GLuint> textures(imageCount);
+		glGenTextures(imageCount, textures.data());
+		for (int i = 0; i < imageCount; i++)
+		{
+			images[i].assign((size_t)size * size * 4, (unsigned char)(i * 37));
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, images[i].data());
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+
+		PixelUnpackRing staging(2, 4 << 20);
+		UploadScheduler uploads(staging, 0, 0.0, 4 << 20);
+		TextureOptions options;
+		options.minFilter = GL_LINEAR_MIPMAP_LINEAR;
+		TextureArray array(size, size, imageCount, options);
+		for (int i = 0; i < imageCount; i++)
+		{
+			array.add(images[i].data(), size, size, 4, uploads);
+		}
+		while (uploads.pending() > 0)
+		{
+			uploads.update();
+		}
+
+		std::vector<std::string> defines(1, "NO_TEXTURE2");
+		Shader single("./Shaders/texture.vs", "./Shaders/texture.fs", defines);
+		single.setInt("texture1", 0);
+		defines[0] = "TEXTURE_ARRAY";
+		Shader layered("./Shaders/texture.vs", "./Shaders/texture.fs", defines);
+		layered.setInt("textureArray", 0);
+
+		// Before : a quad per object already in place, drawn one at a time. After : one unit quad and an instance per object.
+		std::vector<float> vertices, unitQuad;
+		std::vector<unsigned int> indices, unitIndices;
+		gridQuads(count, vertices, indices);
+		gridQuads(1, unitQuad, unitIndices);
+		for (size_t i = 0; i < unitQuad.size(); i += 8)
+		{
+			unitQuad[i] = (unitQuad[i] + 1.0f) / 2.0f;		// Grid of one cell spans the viewport, bring it back to [0, 1]
+			unitQuad[i + 1] = (unitQuad[i + 1] + 1.0f) / 2.0f;
+		}
+		std::vector<float> instances;
+		for (int i = 0; i < count; i++)
+		{
+			float left, bottom, cell;
+			gridCell(i, count, left, bottom, cell);
+			float instance[4] = { left, bottom, cell, (float)(i % imageCount) };
+			instances.insert(instances.end(), instance, instance + 4);
+		}
+
+		GLuint vaos[2], buffers[5];
+		glGenVertexArrays(2, vaos);
+		glGenBuffers(5, buffers);
+		auto quadLayout = [](GLuint vao, GLuint vertexBuffer, GLuint indexBuffer, const std::vector<float>& data, const std::vector<unsigned int>& elements)
+		{
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+			glEnableVertexAttribArray(0);
+			glEnableVertexAttribArray(1);
+			glEnableVertexAttribArray(2);
+		};
+		quadLayout(vaos[0], buffers[0], buffers[1], vertices, indices);
+		quadLayout(vaos[1], buffers[2], buffers[3], unitQuad, unitIndices);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[4]);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+		glVertexAttribDivisor(3, 1);
+		glEnableVertexAttribArray(3);
+		glActiveTexture(GL_TEXTURE0);
+
+		FrameStats separate;
+		single.use();
+		glBindVertexArray(vaos[0]);
+		glFinish();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Timer timer;
+			for (int i = 0; i < count; i++)
+			{
+				glBindTexture(GL_TEXTURE_2D, textures[i % imageCount]);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(i * 6 * sizeof(unsigned int)));
+			}
+			glFinish();
+			separate.add(timer.elapsedMs());
+		}
+
+		FrameStats instanced;
+		layered.use();
+		glBindVertexArray(vaos[1]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.getTexture());
+		glFinish();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Timer timer;
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, count);
+			glFinish();
+			instanced.add(timer.elapsedMs());
+		}
+
+		printf("BENCH::TEXTURE_ARRAY %d objects, %d textures of %dx%d : %d binds and draws p50 %.3f ms, 1 instanced draw p50 %.3f ms\n",
+			count, imageCount, size, size, count, separate.percentile(50.0), instanced.percentile(50.0));
+
+		glBindVertexArray(0);
+		glDeleteVertexArrays(2, vaos);
+		glDeleteBuffers(5, buffers);
+		glDeleteTextures(imageCount, textures.data());
+		glUseProgram(0);
+	}
+
+	/* Decode a JPEG with stb_image, then split at its restart markers on 1, 2, 4... threads up to the core count.
+	   Only files with restart markers scale, "jpegtran -restart 1" adds them without re-encoding. CPU only. */
+	inline void jpegDecode(const char* path = "./Assets/img/container.jpg", int repeats = 5)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			printf("BENCH::JPEG can't open %s\n", path);
+			return;
+		}
+		const unsigned char* data = (const unsigned char*)file.data();
+		int width = 0, height = 0, channels = 0;
+		unsigned char* reference = stbi_load_from_memory(data, (int)file.size(), &width, &height, &channels, 0);
+		if (!reference)
+		{
+			printf("BENCH::JPEG %s : %s\n", path, stbi_failure_reason());
+			return;
+		}
+		size_t imageSize = (size_t)width * height * channels;
+
+		Timer timer;
+		for (int r = 0; r < repeats; r++)
+		{
+			stbi_image_free(stbi_load_from_memory(data, (int)file.size(), &width, &height, &channels, 0));
+		}
+		double serialMs = timer.elapsedMs() / repeats;
+		printf("BENCH::JPEG %s %dx%d, %d channels : stb_image %.2f ms\n", path, width, height, channels, serialMs);
+
+		unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, cores))
+		{
+			std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);		// Plus the calling thread
+			bool parallel = false;
+			unsigned char* pixels = nullptr;
+			timer.reset();
+			for (int r = 0; r < repeats; r++)
+			{
+				stbi_image_free(pixels);
+				pixels = JpegDecoder::load(data, file.size(), &width, &height, &channels, pool.get(), &parallel);
+			}
+			double ms = timer.elapsedMs() / repeats;
+			bool identical = pixels && memcmp(pixels, reference, imageSize) == 0;
+			stbi_image_free(pixels);
+
+			printf("BENCH::JPEG %u threads : %.2f ms, %.2fx stb_image, %s, matches stb_image : %s\n", threads, ms, serialMs / ms,
+				parallel ? "split at restart markers" : "no restart markers, decoded serially", identical ? "yes" : "NO");
+			if (!parallel || threads == cores)
+			{
+				break;
+			}
+		}
+		stbi_image_free(reference);
+	}
+
+	/* Unfilter kernels on a size x size image of filtered rows, scalar then SIMD, for 3 and 4 byte pixels. Then every PNG
+	   in directory, e.g. a corpus of large assets : stbi_load() through FILE* reads, stbi_load_from_memory() and PngDecoder
+	   on a mapping of the file. CPU only. */
+	inline void pngDecode(const char* directory = "./Assets/img", int size = 2048, int repeats = 5)
+	{
+		static const char* filterNames[PngDecoder::FILTER_COUNT] = { "None", "Sub", "Up", "Avg", "Paeth" };
+		for (int bpp = 3; bpp <= 4; bpp++)
+		{
+			size_t rowBytes = (size_t)size * bpp;
+			std::vector<unsigned char> filtered(rowBytes * size), scalar(filtered.size()), simd(filtered.size()), zeros(rowBytes, 0);
+			for (size_t i = 0; i < filtered.size(); i++)
+			{
+				filtered[i] = (unsigned char)(i * 13 + i / 4096);
+			}
+			double megabytes = filtered.size() / (1024.0 * 1024.0);
+
+			for (int filter = PngDecoder::FILTER_SUB; filter < PngDecoder::FILTER_COUNT; filter++)
+			{
+				Timer timer;
+				for (int r = 0; r < repeats; r++)
+				{
+					for (int y = 0; y < size; y++)
+					{
+						unsigned char* row = scalar.data() + y * rowBytes;
+						PngDecoder::unfilterRowScalar(filter, filtered.data() + y * rowBytes, row, y > 0 ? row - rowBytes : zeros.data(), rowBytes, bpp);
+					}
+				}
+				double scalarMs = timer.elapsedMs() / repeats;
+
+				timer.reset();
+				for (int r = 0; r < repeats; r++)
+				{
+					for (int y = 0; y < size; y++)
+					{
+						unsigned char* row = simd.data() + y * rowBytes;
+						PngDecoder::unfilterRow(filter, filtered.data() + y * rowBytes, row, y > 0 ? row - rowBytes : zeros.data(), rowBytes, bpp);
+					}
+				}
+				double simdMs = timer.elapsedMs() / repeats;
+
+				printf("BENCH::PNG unfilter %s, %d bytes per pixel : scalar %.1f MB/s, %s %.1f MB/s, matches scalar : %s\n",
+					filterNames[filter], bpp, megabytes / (scalarMs / 1000.0),
+					filter == PngDecoder::FILTER_PAETH && Simd::hasSSSE3() ? "SSSE3" : "SSE2", megabytes / (simdMs / 1000.0),
+					simd == scalar ? "yes" : "NO");
+			}
+		}
+
+		std::vector<std::string> files = FileSystem::listDirectory(directory);
+		double fileTotal = 0.0, memoryTotal = 0.0, decoderTotal = 0.0;
+		int count = 0;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::string path = std::string(directory) + "/" + files[i];
+			MappedFile file;
+			if (!file.open(path) || !PngDecoder::isPng((const unsigned char*)file.data(), file.size()))
+			{
+				continue;
+			}
+			const unsigned char* data = (const unsigned char*)file.data();
+			int width = 0, height = 0, channels = 0;
+			unsigned char* reference = stbi_load_from_memory(data, (int)file.size(), &width, &height, &channels, 0);
+			if (!reference)
+			{
+				printf("BENCH::PNG %s : %s\n", path.c_str(), stbi_failure_reason());
+				continue;
+			}
+
+			Timer timer;
+			for (int r = 0; r < repeats; r++)
+			{
+				stbi_image_free(stbi_load(path.c_str(), &width, &height, &channels, 0));
+			}
+			double fileMs = timer.elapsedMs() / repeats;
+
+			timer.reset();
+			for (int r = 0; r < repeats; r++)
+			{
+				stbi_image_free(stbi_load_from_memory(data, (int)file.size(), &width, &height, &channels, 0));
+			}
+			double memoryMs = timer.elapsedMs() / repeats;
+
+			bool handled = false;
+			unsigned char* pixels = nullptr;
+			timer.reset();
+			for (int r = 0; r < repeats; r++)
+			{
+				stbi_image_free(pixels);
+				pixels = PngDecoder::load(data, file.size(), &width, &height, &channels, &handled);
+			}
+			double decoderMs = timer.elapsedMs() / repeats;
+			bool identical = pixels && memcmp(pixels, reference, (size_t)width * height * channels) == 0;
+			stbi_image_free(pixels);
+			stbi_image_free(reference);
+
+			printf("BENCH::PNG %s %dx%d, %d channels : stbi_load %.2f ms, stbi_load_from_memory %.2f ms, PngDecoder %.2f ms%s, matches : %s\n",
+				path.c_str(), width, height, channels, fileMs, memoryMs, decoderMs, handled ? "" : " (left to stb)", identical ? "yes" : "NO");
+			fileTotal += fileMs;
+			memoryTotal += memoryMs;
+			decoderTotal += decoderMs;
+			count++;
+		}
+
+		if (count == 0)
+		{
+			printf("BENCH::PNG no PNG in %s\n", directory);
+			return;
+		}
+		printf("BENCH::PNG %d files : stbi_load %.2f ms, stbi_load_from_memory %.2f ms, PngDecoder %.2f ms (%.2fx)\n",
+			count, fileTotal, memoryTotal, decoderTotal, fileTotal / decoderTotal);
+	}
+
+	/* Run the benchmark called name, returns false if it is unknown. input is an optional file for the benchmark to use. */
+	inline bool run(const char* name, const char* input = nullptr)
+	{
+		if (strcmp(name, "uniforms") == 0)
+		{
+			uniformLookup();
+			return true;
+		}
+		if (strcmp(name, "shadercache") == 0)
+		{
+			programBinaryCache();
+			return true;
+		}
+		if (strcmp(name, "shaderbatch") == 0)
+		{
+			shaderBatch();
+			return true;
+		}
+
+		if (strcmp(name, "pipelines") == 0)
+		{
+			pipelines();
+			return true;
+		}
+
+		if (strcmp(name, "upload") == 0)
+		{
+			textureUpload();
+			return true;
+		}
+
+		if (strcmp(name, "streaming") == 0)
+		{
+			uploadStreaming();
+			return true;
+		}
+
+		if (strcmp(name, "mipmaps") == 0)
+		{
+			mipmaps();
+			return true;
+		}
+
+		if (strcmp(name, "compress") == 0)
+		{
+			blockCompression();
+			return true;
+		}
+
+		if (strcmp(name, "atlas") == 0)
+		{
+			textureAtlas();
+			return true;
+		}
+
+		if (strcmp(name, "texarray") == 0)
+		{
+			textureArray();
+			return true;
+		}
+
+		if (strcmp(name, "jpeg") == 0)
+		{
+			jpegDecode(input ? input : "./Assets/img/container.jpg");
+			return true;
+		}
+
+		if (strcmp(name, "png") == 0)
+		{
+			pngDecode(input ? input : "./Assets/img");
+			return true;
+		}
+
+		printf("Unknown benchmark : %s\n", name);
+		return false;
+	}
+}
+
+#endif
@@ -0,0 +1,428 @@
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+enum BlockFormat
+{
+	BLOCK_FORMAT_BC1,		// RGB, 8 bytes per 4x4 block : 6x smaller than RGB8
+	BLOCK_FORMAT_BC3,		// RGBA, BC1 color plus an 8 level alpha block, 16 bytes per block : 4x smaller than RGBA8
+	BLOCK_FORMAT_BC7		// RGBA, mode 6 only (one subset, 16 levels), 16 bytes per block, better color than BC3
+};
+
+/* Real time block compression : endpoints from the inset bounding box of each block along its main diagonal,
+   indices from projecting the texels on the endpoint axis. Much faster than an exhaustive encoder and good enough
+   for color textures. Texel unpacking, bounds and projection use SSE2; blocks rows are split across the pool. */
+class BlockCompressor
+{
+public:
+	explicit BlockCompressor(ThreadPool* pool = nullptr)
+		: pool(pool)
+	{
+	}
+
+	static size_t blockBytes(BlockFormat format)
+	{
+		return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+	}
+
+	/* Bytes of a width x height level, partial blocks on the edges count as whole ones */
+	static size_t compressedSize(BlockFormat format, int width, int height)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	/* BC3 whenever the channels carry alpha, grey + alpha included, BC1 otherwise */
+	static BlockFormat opaqueOrAlpha(int channels)
+	{
+		return channels == 2 || channels == 4 ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1;
+	}
+
+	static const char* name(BlockFormat format)
+	{
+		static const char* names[] = { "BC1", "BC3", "BC7" };
+		return names[format];
+	}
+
+	/* Compress tightly packed 8-bit pixels of 1 to 4 channels into blocks, in row order.
+	   Grey (1 channel) and grey + alpha (2 channels) are replicated into RGB, missing alpha reads 255.
+	   Edge blocks repeat the last row and column. */
+	void compress(const unsigned char* pixels, int width, int height, int channels, BlockFormat format, unsigned char* blocks) const
+	{
+		int blocksX = (width + 3) / 4;
+		int blocksY = (height + 3) / 4;
+		size_t bytes = blockBytes(format);
+		auto body = [=](size_t begin, size_t end)
+		{
+			unsigned char rgba[64];
+			for (size_t by = begin; by < end; by++)
+			{
+				unsigned char* out = blocks + by * blocksX * bytes;
+				for (int bx = 0; bx < blocksX; bx++, out += bytes)
+				{
+					fetch(pixels, width, height, channels, bx * 4, (int)by * 4, rgba);
+					if (format == BLOCK_FORMAT_BC1)
+					{
+						encodeColor(rgba, out);
+					}
+					else if (format == BLOCK_FORMAT_BC3)
+					{
+						encodeAlpha(rgba, out);
+						encodeColor(rgba, out + 8);
+					}
+					else
+					{
+						encodeMode6(rgba, out);
+					}
+				}
+			}
+		};
+
+		size_t grain = std::max((size_t)1, (size_t)1024 / (size_t)blocksX);		// About a thousand blocks per chunk
+		if (pool && (size_t)blocksY > grain)
+		{
+			pool->parallelFor((size_t)blocksY, grain, body);
+		}
+		else
+		{
+			body(0, (size_t)blocksY);
+		}
+	}
+
+	void compress(const unsigned char* pixels, int width, int height, int channels, BlockFormat format, std::vector<unsigned char>& blocks) const
+	{
+		blocks.resize(compressedSize(format, width, height));
+		compress(pixels, width, height, channels, format, blocks.data());
+	}
+
+private:
+	ThreadPool* pool;
+
+	/* 4x4 texels at (x, y) expanded to RGBA */
+	static void fetch(const unsigned char* pixels, int width, int height, int channels, int x, int y, unsigned char* rgba)
+	{
+		if (channels == 4 && x + 4 <= width && y + 4 <= height)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				memcpy(rgba + 16 * row, pixels + ((size_t)(y + row) * width + x) * 4, 16);
+			}
+			return;
+		}
+
+		for (int row = 0; row < 4; row++)
+		{
+			const unsigned char* line = pixels + (size_t)std::min(y + row, height - 1) * width * channels;
+			for (int column = 0; column < 4; column++)
+			{
+				const unsigned char* texel = line + (size_t)std::min(x + column, width - 1) * channels;
+				unsigned char* out = rgba + 16 * row + 4 * column;
+				if (channels < 3)
+				{
+					out[0] = out[1] = out[2] = texel[0];
+					out[3] = channels == 2 ? texel[1] : 255;
+				}
+				else
+				{
+					out[0] = texel[0];
+					out[1] = texel[1];
+					out[2] = texel[2];
+					out[3] = channels == 4 ? texel[3] : 255;
+				}
+			}
+		}
+	}
+
+	/* Per channel minimum and maximum of the 16 texels */
+	static void bounds(const unsigned char* rgba, unsigned char* low, unsigned char* high)
+	{
+#ifdef SIMD_X86
+		__m128i row0 = _mm_loadu_si128((const __m128i*)rgba);
+		__m128i row1 = _mm_loadu_si128((const __m128i*)(rgba + 16));
+		__m128i row2 = _mm_loadu_si128((const __m128i*)(rgba + 32));
+		__m128i row3 = _mm_loadu_si128((const __m128i*)(rgba + 48));
+		__m128i minimum = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+		__m128i maximum = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+		minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 8));
+		minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+		maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 8));
+		maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+		int lowBits = _mm_cvtsi128_si32(minimum);
+		int highBits = _mm_cvtsi128_si32(maximum);
+		memcpy(low, &lowBits, 4);
+		memcpy(high, &highBits, 4);
+#else
+		for (int c = 0; c < 4; c++)
+		{
+			low[c] = 255;
+			high[c] = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				low[c] = std::min(low[c], rgba[4 * i + c]);
+				high[c] = std::max(high[c], rgba[4 * i + c]);
+			}
+		}
+#endif
+	}
+
+	/* Level of each texel along axis : round((dot(texel, axis) - base) * scale), clamped to [0, maxLevel] */
+	static void project(const unsigned char* rgba, const float* axis, float base, float scale, int maxLevel, int* levels)
+	{
+#ifdef SIMD_X86
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		const __m128 axisR = _mm_set1_ps(axis[0]), axisG = _mm_set1_ps(axis[1]), axisB = _mm_set1_ps(axis[2]), axisA = _mm_set1_ps(axis[3]);
+		const __m128 offset = _mm_set1_ps(base), factor = _mm_set1_ps(scale);
+		const __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps((float)maxLevel);
+		for (int row = 0; row < 4; row++)
+		{
+			// 4 texels, channels split into one register each
+			__m128i texels = _mm_loadu_si128((const __m128i*)(rgba + 16 * row));
+			__m128 r = _mm_cvtepi32_ps(_mm_and_si128(texels, byteMask));
+			__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 8), byteMask));
+			__m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 16), byteMask));
+			__m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(texels, 24));
+
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, axisR), _mm_mul_ps(g, axisG)), _mm_add_ps(_mm_mul_ps(b, axisB), _mm_mul_ps(a, axisA)));
+			__m128 level = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(dot, offset), factor), zero), top);
+			_mm_storeu_si128((__m128i*)(levels + 4 * row), _mm_cvtps_epi32(level));
+		}
+#else
+		for (int i = 0; i < 16; i++)
+		{
+			const unsigned char* texel = rgba + 4 * i;
+			float dot = texel[0] * axis[0] + texel[1] * axis[1] + texel[2] * axis[2] + texel[3] * axis[3];
+			float level = std::min(std::max((dot - base) * scale, 0.0f), (float)maxLevel);
+			levels[i] = (int)(level + 0.5f);
+		}
+#endif
+	}
+
+	/* Orient the bounding box along the block's main diagonal : a channel that decreases while green increases
+	   swaps its low and high ends. Only the channels in mask are considered. */
+	static void orient(const unsigned char* rgba, unsigned char* low, unsigned char* high, const bool* mask)
+	{
+		int mean[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				mean[c] += rgba[4 * i + c];
+			}
+		}
+		int covariance[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			int green = 16 * rgba[4 * i + 1] - mean[1];
+			for (int c = 0; c < 4; c++)
+			{
+				covariance[c] += (16 * rgba[4 * i + c] - mean[c]) * green;
+			}
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			if (mask[c] && c != 1 && covariance[c] < 0)
+			{
+				std::swap(low[c], high[c]);
+			}
+		}
+	}
+
+	static uint16_t to565(const int* color)
+	{
+		return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+	}
+
+	static void from565(uint16_t packed, float* color)
+	{
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (float)(r << 3 | r >> 2);
+		color[1] = (float)(g << 2 | g >> 4);
+		color[2] = (float)(b << 3 | b >> 2);
+		color[3] = 0.0f;
+	}
+
+	/* BC1 color block : two 565 endpoints, color0 > color1 for the 4 color mode, then 2-bit indices */
+	static void encodeColor(const unsigned char* rgba, unsigned char* out)
+	{
+		static const bool mask[4] = { true, true, true, false };
+		unsigned char low[4], high[4];
+		bounds(rgba, low, high);
+		orient(rgba, low, high, mask);
+
+		// Inset by 1/16 of the range, the extremes are rarely worth an endpoint of their own
+		int first[3], second[3];
+		for (int c = 0; c < 3; c++)
+		{
+			int inset = (high[c] - low[c]) / 16;
+			first[c] = high[c] - inset;
+			second[c] = low[c] + inset;
+		}
+		uint16_t color0 = to565(first);
+		uint16_t color1 = to565(second);
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			float end0[4], end1[4], axis[4];
+			from565(color0, end0);
+			from565(color1, end1);
+			for (int c = 0; c < 4; c++)
+			{
+				axis[c] = end0[c] - end1[c];
+			}
+			float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			float base = end1[0] * axis[0] + end1[1] * axis[1] + end1[2] * axis[2];
+
+			// Level 0 is color1, 3 is color0 ; the palette order is color0, color1, 2/3 color0, 1/3 color0
+			static const uint32_t paletteIndex[4] = { 1, 3, 2, 0 };
+			int levels[16];
+			project(rgba, axis, base, 3.0f / length, 3, levels);
+			uint32_t flip = color0 < color1 ? 1 : 0;		// Swapping the endpoints swaps the indices of each pair
+			for (int i = 0; i < 16; i++)
+			{
+				indices |= (paletteIndex[levels[i]] ^ flip) << (2 * i);
+			}
+			if (flip)
+			{
+				std::swap(color0, color1);
+			}
+		}
+
+		out[0] = (unsigned char)(color0 & 0xFF);
+		out[1] = (unsigned char)(color0 >> 8);
+		out[2] = (unsigned char)(color1 & 0xFF);
+		out[3] = (unsigned char)(color1 >> 8);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	/* BC3 alpha block : alpha0 > alpha1 for the 8 level mode, then 3-bit indices */
+	static void encodeAlpha(const unsigned char* rgba, unsigned char* out)
+	{
+		unsigned char low[4], high[4];
+		bounds(rgba, low, high);
+		unsigned char alpha0 = high[3], alpha1 = low[3];
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			// Level 0 is alpha1, 7 is alpha0 ; the palette order is alpha0, alpha1, then 6/7 alpha0 down to 1/7 alpha0
+			static const float axis[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			static const uint64_t paletteIndex[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+			int levels[16];
+			project(rgba, axis, (float)alpha1, 7.0f / (alpha0 - alpha1), 7, levels);
+			for (int i = 0; i < 16; i++)
+			{
+				indices |= paletteIndex[levels[i]] << (3 * i);
+			}
+		}
+
+		out[0] = alpha0;
+		out[1] = alpha1;
+		for (int i = 0; i < 6; i++)
+		{
+			out[2 + i] = (unsigned char)(indices >> (8 * i));
+		}
+	}
+
+	/* Least significant bit first, the order BC7 fields are stored in */
+	struct BitWriter
+	{
+		unsigned char* out;
+		int position;
+
+		void write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, position++)
+			{
+				out[position >> 3] |= (unsigned char)(((value >> i) & 1) << (position & 7));
+			}
+		}
+	};
+
+	/* 7-bit value plus the shared low bit that reproduces an 8-bit endpoint best */
+	static void quantizeMode6(const unsigned char* color, int* quantized, int& pBit)
+	{
+		int bestError = -1;
+		pBit = 0;
+		for (int p = 0; p < 2; p++)
+		{
+			int candidate[4];
+			int error = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				candidate[c] = std::min(127, std::max(0, (color[c] - p + 1) >> 1));
+				int value = candidate[c] << 1 | p;
+				error += (value - color[c]) * (value - color[c]);
+			}
+			if (bestError < 0 || error < bestError)
+			{
+				bestError = error;
+				pBit = p;
+				memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	/* BC7 mode 6 : one RGBA 7777 endpoint pair with a p-bit each, 4-bit indices, the first texel's top index bit implied 0 */
+	static void encodeMode6(const unsigned char* rgba, unsigned char* out)
+	{
+		static const bool mask[4] = { true, true, true, true };
+		unsigned char low[4], high[4];
+		bounds(rgba, low, high);
+		orient(rgba, low, high, mask);
+
+		int endpoint[2][4], pBit[2];
+		quantizeMode6(low, endpoint[0], pBit[0]);
+		quantizeMode6(high, endpoint[1], pBit[1]);
+
+		float axis[4], base = 0.0f, length = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			float end0 = (float)(endpoint[0][c] << 1 | pBit[0]);
+			float end1 = (float)(endpoint[1][c] << 1 | pBit[1]);
+			axis[c] = end1 - end0;
+			base += end0 * axis[c];
+			length += axis[c] * axis[c];
+		}
+
+		int levels[16] = { 0 };
+		if (length > 0.0f)
+		{
+			project(rgba, axis, base, 15.0f / length, 15, levels);
+		}
+		if (levels[0] >= 8)
+		{
+			std::swap(endpoint[0], endpoint[1]);
+			std::swap(pBit[0], pBit[1]);
+			for (int i = 0; i < 16; i++)
+			{
+				levels[i] = 15 - levels[i];
+			}
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer = { out, 0 };
+		writer.write(1 << 6, 7);		// Mode 6
+		for (int c = 0; c < 4; c++)
+		{
+			writer.write((uint32_t)endpoint[0][c], 7);
+			writer.write((uint32_t)endpoint[1][c], 7);
+		}
+		writer.write((uint32_t)pBit[0], 1);
+		writer.write((uint32_t)pBit[1], 1);
+		writer.write((uint32_t)levels[0], 3);
+		for (int i = 1; i < 16; i++)
+		{
+			writer.write((uint32_t)levels[i], 4);
+		}
+	}
+};
+
+#endif
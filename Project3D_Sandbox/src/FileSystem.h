@@ -0,0 +1,272 @@
+#ifndef FILE_SYSTEM_H
+#define FILE_SYSTEM_H
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read-only memory mapping of a whole file, pages are only loaded when touched */
+class MappedFile
+{
+public:
+	MappedFile()
+		: bytes(nullptr), length(0)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+	{
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		length = (size_t)fileSize.QuadPart;
+		if (length == 0)
+		{
+			bytes = "";		// Empty files can't be mapped
+			return true;
+		}
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		bytes = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		length = (size_t)info.st_size;
+		if (length == 0)
+		{
+			::close(fd);
+			bytes = "";		// Empty files can't be mapped
+			return true;
+		}
+
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);		// The mapping keeps the file referenced
+		bytes = address == MAP_FAILED ? nullptr : (const char*)address;
+#endif
+		if (!bytes)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (bytes && length > 0)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(bytes);
+#else
+			munmap((void*)bytes, length);
+#endif
+		}
+#ifdef _WIN32
+		if (mapping)
+		{
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const
+	{
+		return bytes != nullptr;
+	}
+
+	const char* data() const
+	{
+		return bytes;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	const char* bytes;
+	size_t length;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+namespace FileSystem
+{
+	/* Directory of the running executable, with a trailing separator */
+	inline std::string executableDirectory()
+	{
+		char path[4096] = { 0 };
+#ifdef _WIN32
+		DWORD length = GetModuleFileNameA(NULL, path, sizeof(path) - 1);
+#else
+		ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+#endif
+		if (length <= 0)
+		{
+			return std::string();
+		}
+
+		std::string directory(path, (size_t)length);
+		std::string::size_type slash = directory.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+	}
+
+	inline bool isRelative(const std::string& path)
+	{
+		if (path.empty())
+		{
+			return true;
+		}
+#ifdef _WIN32
+		if (path.size() > 1 && path[1] == ':')
+		{
+			return false;
+		}
+#endif
+		return path[0] != '/' && path[0] != '\\';
+	}
+
+	/* "./Shaders\\a.fs" -> "Shaders/a.fs", the form used as a key for embedded files */
+	inline std::string normalize(const std::string& path)
+	{
+		std::string normalized(path);
+		for (size_t i = 0; i < normalized.size(); i++)
+		{
+			if (normalized[i] == '\\')
+			{
+				normalized[i] = '/';
+			}
+		}
+		while (normalized.compare(0, 2, "./") == 0)
+		{
+			normalized.erase(0, 2);
+		}
+		return normalized;
+	}
+
+	/* Absolute form of path with "." and ".." resolved and forward slashes, lower case on Windows where names
+	   ignore case : two spellings of the same file give the same string. Falls back to normalize() if the OS can't resolve it. */
+	inline std::string canonical(const std::string& path)
+	{
+		char resolved[4096];
+#ifdef _WIN32
+		if (!_fullpath(resolved, path.c_str(), sizeof(resolved)))
+		{
+			return normalize(path);
+		}
+		std::string result = normalize(resolved);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			result[i] = (char)tolower((unsigned char)result[i]);
+		}
+		return result;
+#else
+		if (!realpath(path.c_str(), resolved))
+		{
+			return normalize(path);
+		}
+		return std::string(resolved);
+#endif
+	}
+
+	/* Names of the regular files directly inside directory, sorted so the result doesn't depend on the OS */
+	inline std::vector<std::string> listDirectory(const std::string& directory)
+	{
+		std::vector<std::string> files;
+#ifdef _WIN32
+		WIN32_FIND_DATAA entry;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &entry);
+		if (find == INVALID_HANDLE_VALUE)
+		{
+			return files;
+		}
+		do
+		{
+			if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			{
+				files.push_back(entry.cFileName);
+			}
+		} while (FindNextFileA(find, &entry));
+		FindClose(find);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (!dir)
+		{
+			return files;
+		}
+		while (struct dirent* entry = readdir(dir))
+		{
+			struct stat info;
+			std::string path = directory + "/" + entry->d_name;
+			if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+			{
+				files.push_back(entry->d_name);
+			}
+		}
+		closedir(dir);
+#endif
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef FORMAT_NORMALIZER_H
+#define FORMAT_NORMALIZER_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Simd.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/* How the rows of an image are laid out for upload, and what GL stores them as */
+struct UploadFormat
+{
+	GLint internalFormat;
+	GLenum format;
+	GLenum type;
+	int bytesPerPixel;		// Of the rows handed to GL
+};
+
+/* Conversion pass between decoding and upload. Picks the most compact format for the channel count, rewrites rows
+   into it and applies what would otherwise take passes of their own : premultiplied alpha and the vertical flip,
+   done by writing the rows bottom up. RGB is padded to RGBA with SSSE3, premultiplying and packing to RGB565 use SSE2. */
+namespace FormatNormalizer
+{
+	/* R8 and RG8 as they are. RGB8 is uploaded from RGBA rows : 4 byte texels keep rows aligned and drivers
+	   store RGB padded anyway, so they copy instead of swizzling. With compact, opaque RGB goes to RGB565 instead. */
+	inline UploadFormat choose(int channels, bool compact = false)
+	{
+		UploadFormat format;
+		switch (channels)
+		{
+		case 1:
+			format.internalFormat = GL_R8;
+			format.format = GL_RED;
+			format.bytesPerPixel = 1;
+			break;
+		case 2:
+			format.internalFormat = GL_RG8;
+			format.format = GL_RG;
+			format.bytesPerPixel = 2;
+			break;
+		case 3:
+			format.internalFormat = compact ? GL_RGB565 : GL_RGB8;
+			format.format = compact ? GL_RGB : GL_RGBA;
+			format.bytesPerPixel = compact ? 2 : 4;
+			break;
+		default:
+			format.internalFormat = GL_RGBA8;
+			format.format = GL_RGBA;
+			format.bytesPerPixel = 4;
+			break;
+		}
+		format.type = format.internalFormat == GL_RGB565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+		return format;
+	}
+
+	/* Rows kept as decoded, e.g. for the block compressor which reads any channel count */
+	inline UploadFormat tight(int channels)
+	{
+		static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		static const GLint internalFormats[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+		UploadFormat format = { internalFormats[channels - 1], formats[channels - 1], GL_UNSIGNED_BYTE, channels };
+		return format;
+	}
+
+	/* Gray is stored in R8 and gray + alpha in RG8, the swizzle has shaders read them as (g, g, g, 1) and (g, g, g, a)
+	   like the RGBA they would otherwise be. Call on the GL thread once the texture exists, it binds the texture. */
+	inline void swizzle(GLuint texture, GLint internalFormat)
+	{
+		static const GLint gray[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		static const GLint grayAlpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+		if (internalFormat != GL_R8 && internalFormat != GL_RG8)
+		{
+			return;
+		}
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, internalFormat == GL_R8 ? gray : grayAlpha);
+	}
+
+	/* Whether convert() would change anything, flipping aside */
+	inline bool needsConversion(int channels, const UploadFormat& format, bool premultiply)
+	{
+		return format.bytesPerPixel != channels || format.type != GL_UNSIGNED_BYTE || (premultiply && channels == 4);
+	}
+
+	/* ===================================== Row kernels ===================================== */
+
+	inline void expandRGBScalar(const unsigned char* source, unsigned char* destination, int x, int width)
+	{
+		for (; x < width; x++)
+		{
+			destination[4 * x] = source[3 * x];
+			destination[4 * x + 1] = source[3 * x + 1];
+			destination[4 * x + 2] = source[3 * x + 2];
+			destination[4 * x + 3] = 255;
+		}
+	}
+
+	/* x * a / 255 rounded, exact for 8-bit x and a */
+	inline unsigned char multiply255(unsigned int x, unsigned int a)
+	{
+		unsigned int t = x * a + 128;
+		return (unsigned char)((t + (t >> 8)) >> 8);
+	}
+
+	inline void premultiplyScalar(unsigned char* rgba, int x, int width)
+	{
+		for (; x < width; x++)
+		{
+			unsigned int a = rgba[4 * x + 3];
+			rgba[4 * x] = multiply255(rgba[4 * x], a);
+			rgba[4 * x + 1] = multiply255(rgba[4 * x + 1], a);
+			rgba[4 * x + 2] = multiply255(rgba[4 * x + 2], a);
+		}
+	}
+
+	inline void packRGB565Scalar(const unsigned char* rgba, uint16_t* destination, int x, int width)
+	{
+		for (; x < width; x++)
+		{
+			const unsigned char* texel = rgba + 4 * x;
+			destination[x] = (uint16_t)(((texel[0] & 0xF8) << 8) | ((texel[1] & 0xFC) << 3) | (texel[2] >> 3));
+		}
+	}
+
+#ifdef SIMD_X86
+	/* 4 texels per iteration, the 16 byte load reads 4 bytes past them so the last 6 texels are left to the tail.
+	   Returns how many texels were done. */
+	SIMD_TARGET_SSSE3 inline int expandRGBSSSE3(const unsigned char* source, unsigned char* destination, int width)
+	{
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+		int x = 0;
+		for (; x + 6 <= width; x += 4)
+		{
+			__m128i rgb = _mm_loadu_si128((const __m128i*)(source + 3 * x));
+			_mm_storeu_si128((__m128i*)(destination + 4 * x), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+		}
+		return x;
+	}
+
+	/* 4 texels per iteration in 16 bits, alpha is put back untouched */
+	inline int premultiplySSE2(unsigned char* rgba, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i half = _mm_set1_epi16(128);
+		const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i texels = _mm_loadu_si128((const __m128i*)(rgba + 4 * x));
+			__m128i low = _mm_unpacklo_epi8(texels, zero);
+			__m128i high = _mm_unpackhi_epi8(texels, zero);
+			__m128i lowAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(low, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m128i highAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(high, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+			// (t + (t >> 8)) >> 8 with t = x * a + 128, like multiply255()
+			low = _mm_add_epi16(_mm_mullo_epi16(low, lowAlpha), half);
+			high = _mm_add_epi16(_mm_mullo_epi16(high, highAlpha), half);
+			low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+			high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+			__m128i result = _mm_packus_epi16(low, high);
+			result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, texels));
+			_mm_storeu_si128((__m128i*)(rgba + 4 * x), result);
+		}
+		return x;
+	}
+
+	/* 8 texels per iteration. Values are sign extended before the saturating pack so 0x8000 and up come through. */
+	inline int packRGB565SSE2(const unsigned char* rgba, uint16_t* destination, int width)
+	{
+		const __m128i red = _mm_set1_epi32(0xF8);
+		const __m128i green = _mm_set1_epi32(0x7E0);
+		const __m128i blue = _mm_set1_epi32(0x1F);
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i packed[2];
+			for (int half = 0; half < 2; half++)
+			{
+				__m128i texels = _mm_loadu_si128((const __m128i*)(rgba + 4 * x + 16 * half));
+				__m128i value = _mm_slli_epi32(_mm_and_si128(texels, red), 8);
+				value = _mm_or_si128(value, _mm_and_si128(_mm_srli_epi32(texels, 5), green));
+				value = _mm_or_si128(value, _mm_and_si128(_mm_srli_epi32(texels, 19), blue));
+				packed[half] = _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+			}
+			_mm_storeu_si128((__m128i*)(destination + x), _mm_packs_epi32(packed[0], packed[1]));
+		}
+		return x;
+	}
+#endif
+
+	inline void expandRGB(const unsigned char* source, unsigned char* destination, int width)
+	{
+		int x = 0;
+#ifdef SIMD_X86
+		if (Simd::hasSSSE3())
+		{
+			x = expandRGBSSSE3(source, destination, width);
+		}
+#endif
+		expandRGBScalar(source, destination, x, width);
+	}
+
+	inline void premultiply(unsigned char* rgba, int width)
+	{
+		int x = 0;
+#ifdef SIMD_X86
+		x = premultiplySSE2(rgba, width);
+#endif
+		premultiplyScalar(rgba, x, width);
+	}
+
+	inline void packRGB565(const unsigned char* rgba, uint16_t* destination, int width)
+	{
+		int x = 0;
+#ifdef SIMD_X86
+		x = packRGB565SSE2(rgba, destination, width);
+#endif
+		packRGB565Scalar(rgba, destination, x, width);
+	}
+
+	/* Rewrite tightly packed rows of channels bytes into format, out holding width * height * format.bytesPerPixel bytes.
+	   premultiply only applies to RGBA. */
+	inline void convert(const unsigned char* pixels, int width, int height, int channels, const UploadFormat& format,
+		bool premultiplyAlpha, bool flip, unsigned char* out)
+	{
+		size_t sourceRow = (size_t)width * channels;
+		size_t targetRow = (size_t)width * format.bytesPerPixel;
+		bool compact = format.type == GL_UNSIGNED_SHORT_5_6_5;
+		std::vector<unsigned char> scratch(compact ? (size_t)width * 4 : 0);		// RGBA row before packing
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* source = pixels + (size_t)y * sourceRow;
+			unsigned char* target = out + (size_t)(flip ? height - 1 - y : y) * targetRow;
+			unsigned char* rgba = compact ? scratch.data() : target;
+			if (channels == 3 && format.bytesPerPixel != 3)
+			{
+				expandRGB(source, rgba, width);
+			}
+			else if (rgba != source)
+			{
+				memcpy(rgba, source, sourceRow);
+			}
+
+			if (premultiplyAlpha && channels == 4)
+			{
+				premultiply(rgba, width);
+			}
+			if (compact)
+			{
+				packRGB565(rgba, (uint16_t*)target, width);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include "Std140.h"
+
+/* Per-frame data shared by every program, mirrors the FrameData block of Shaders/frame_data.glsl */
+struct FrameData
+{
+	typedef Std140Layout<std140::vec4, std140::vec2, float> Layout;
+
+	std140::vec4 tint;				// Multiplied with the final color
+	std140::vec2 resolution;		// Framebuffer size in pixels
+	float time;						// Seconds since startup
+};
+
+STD140_MEMBER(FrameData, 0, tint);
+STD140_MEMBER(FrameData, 1, resolution);
+STD140_MEMBER(FrameData, 2, time);
+
+#endif
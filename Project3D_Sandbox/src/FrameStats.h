@@ -0,0 +1,58 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+/* Frame times of the last frames, to watch percentiles rather than averages : a streaming hitch every
+   few seconds barely moves the mean but shows up in the p99 */
+class FrameStats
+{
+public:
+	explicit FrameStats(size_t window = 1024)
+		: next(0), count(0), worst(0.0)
+	{
+		samples.resize(window > 0 ? window : 1);
+	}
+
+	void add(double frameMs)
+	{
+		samples[next] = frameMs;
+		next = (next + 1) % samples.size();
+		count = std::min(count + 1, samples.size());
+		worst = std::max(worst, frameMs);
+	}
+
+	/* Percentile in [0, 100] of the frames in the window, 0 if none were recorded */
+	double percentile(double p) const
+	{
+		if (count == 0)
+		{
+			return 0.0;
+		}
+		std::vector<double> sorted(samples.begin(), samples.begin() + count);
+		size_t rank = (size_t)(p / 100.0 * (count - 1) + 0.5);
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		return sorted[rank];
+	}
+
+	/* Slowest frame since start, not only in the window */
+	double max() const
+	{
+		return worst;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+private:
+	std::vector<double> samples;	// Ring of the last frame times in ms
+	size_t next;
+	size_t count;
+	double worst;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <string.h>
+
+/* glad is generated for the 3.3 core profile only. Everything newer is declared here
+   and loaded at runtime when the driver exposes the matching version or extension. */
+
+/* ARB_get_program_binary (core in 4.1) */
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+/* KHR_parallel_shader_compile (or its ARB twin) */
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+/* ARB_separate_shader_objects (core in 4.1) */
+#define GL_VERTEX_SHADER_BIT 0x00000001
+#define GL_FRAGMENT_SHADER_BIT 0x00000002
+#define GL_PROGRAM_SEPARABLE 0x8258
+
+typedef void (APIENTRYP PFNGLGENPROGRAMPIPELINESPROC)(GLsizei n, GLuint* pipelines);
+typedef void (APIENTRYP PFNGLDELETEPROGRAMPIPELINESPROC)(GLsizei n, const GLuint* pipelines);
+typedef void (APIENTRYP PFNGLBINDPROGRAMPIPELINEPROC)(GLuint pipeline);
+typedef void (APIENTRYP PFNGLUSEPROGRAMSTAGESPROC)(GLuint pipeline, GLbitfield stages, GLuint program);
+typedef void (APIENTRYP PFNGLACTIVESHADERPROGRAMPROC)(GLuint pipeline, GLuint program);
+
+/* EXT_texture_compression_s3tc (BC1 to BC3) and ARB_texture_compression_bptc (BC7, core in 4.2) */
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+
+/* ARB_ES2_compatibility (core in 4.1), for the GL_RGB565 internal format */
+#define GL_RGB565 0x8D62
+
+struct GLExtensions
+{
+	bool programBinary;
+	bool parallelShaderCompile;
+	bool separateShaderObjects;
+	bool textureCompressionS3TC;
+	bool textureCompressionBPTC;
+	bool rgb565;
+
+	PFNGLGETPROGRAMBINARYPROC GetProgramBinary;
+	PFNGLPROGRAMBINARYPROC ProgramBinary;
+	PFNGLPROGRAMPARAMETERIPROC ProgramParameteri;
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreads;
+	PFNGLGENPROGRAMPIPELINESPROC GenProgramPipelines;
+	PFNGLDELETEPROGRAMPIPELINESPROC DeleteProgramPipelines;
+	PFNGLBINDPROGRAMPIPELINEPROC BindProgramPipeline;
+	PFNGLUSEPROGRAMSTAGESPROC UseProgramStages;
+	PFNGLACTIVESHADERPROGRAMPROC ActiveShaderProgram;
+
+	/* Loaded extensions, filled once by load() after gladLoadGLLoader */
+	static GLExtensions& get()
+	{
+		static GLExtensions extensions = GLExtensions();
+		return extensions;
+	}
+
+	static bool isSupported(const char* name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && strcmp(extension, name) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool hasVersion(int major, int minor)
+	{
+		GLint currentMajor = 0, currentMinor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &currentMajor);
+		glGetIntegerv(GL_MINOR_VERSION, &currentMinor);
+		return currentMajor > major || (currentMajor == major && currentMinor >= minor);
+	}
+
+	static void load(GLADloadproc loader)
+	{
+		GLExtensions& ext = get();
+		const bool version41 = hasVersion(4, 1);
+
+		/* Program binaries : also need at least one binary format, some drivers advertise the entry points with none */
+		if (version41 || isSupported("GL_ARB_get_program_binary"))
+		{
+			ext.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loader("glGetProgramBinary");
+			ext.ProgramBinary = (PFNGLPROGRAMBINARYPROC)loader("glProgramBinary");
+			ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+		}
+
+		/* Parallel compile : the driver compiles in the background, GL_COMPLETION_STATUS_KHR polls without blocking */
+		if (isSupported("GL_KHR_parallel_shader_compile"))
+		{
+			ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader("glMaxShaderCompilerThreadsKHR");
+		}
+		else if (isSupported("GL_ARB_parallel_shader_compile"))
+		{
+			ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader("glMaxShaderCompilerThreadsARB");
+		}
+		ext.parallelShaderCompile = ext.MaxShaderCompilerThreads != nullptr;
+
+		/* Separable programs and pipelines, glProgramParameteri is shared with program binaries */
+		if (version41 || isSupported("GL_ARB_separate_shader_objects"))
+		{
+			ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+			ext.GenProgramPipelines = (PFNGLGENPROGRAMPIPELINESPROC)loader("glGenProgramPipelines");
+			ext.DeleteProgramPipelines = (PFNGLDELETEPROGRAMPIPELINESPROC)loader("glDeleteProgramPipelines");
+			ext.BindProgramPipeline = (PFNGLBINDPROGRAMPIPELINEPROC)loader("glBindProgramPipeline");
+			ext.UseProgramStages = (PFNGLUSEPROGRAMSTAGESPROC)loader("glUseProgramStages");
+			ext.ActiveShaderProgram = (PFNGLACTIVESHADERPROGRAMPROC)loader("glActiveShaderProgram");
+			ext.separateShaderObjects = ext.ProgramParameteri && ext.GenProgramPipelines && ext.DeleteProgramPipelines
+				&& ext.BindProgramPipeline && ext.UseProgramStages && ext.ActiveShaderProgram;
+		}
+		/* Block compressed formats only need the enums, uploads go through the core glCompressedTexImage2D */
+		ext.textureCompressionS3TC = isSupported("GL_EXT_texture_compression_s3tc");
+		ext.textureCompressionBPTC = hasVersion(4, 2) || isSupported("GL_ARB_texture_compression_bptc");
+		ext.rgb565 = version41 || isSupported("GL_ARB_ES2_compatibility");
+
+		if (ext.parallelShaderCompile)
+		{
+			ext.MaxShaderCompilerThreads(0xFFFFFFFF);		// Let the driver pick the number of threads
+		}
+	}
+};
+
+#endif
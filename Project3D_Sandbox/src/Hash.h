@@ -0,0 +1,47 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* FNV-1a hashes, constexpr so names known at compile time cost nothing at runtime */
+constexpr uint32_t fnv1a32(const char* data, size_t length, uint32_t hash = 2166136261u)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+constexpr uint32_t fnv1a32(const char* str)
+{
+	uint32_t hash = 2166136261u;
+	for (; *str != '\0'; str++)
+	{
+		hash = (hash ^ (uint8_t)*str) * 16777619u;
+	}
+	return hash;
+}
+
+/* Length of str up to its first NUL, at most max : char arrays may hold a shorter string than their size */
+constexpr size_t boundedLength(const char* str, size_t max)
+{
+	size_t length = 0;
+	while (length < max && str[length] != '\0')
+	{
+		length++;
+	}
+	return length;
+}
+
+constexpr uint64_t fnv1a64(const char* data, size_t length, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+#endif
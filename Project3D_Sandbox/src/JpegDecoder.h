@@ -0,0 +1,357 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include "ThreadPool.h"
+
+#include <stb_image.h>
+
+#include <stddef.h>
+
+/* Baseline JPEG decode split across restart intervals. A restart marker resets the entropy decoder and the DC
+   predictions, so the segments between two of them decode independently : they are found with a byte scan,
+   then decoded on the pool straight into the component planes, with the IDCT, upsampling and color conversion
+   kernels of stb_image. Files without restart markers, progressive or multi-scan files, CMYK, and anything
+   unexpected are handed to stbi_load_from_memory(), which gives the same pixels, only serially.
+
+   The implementation calls into stb_image internals, so it is compiled in the file defining STB_IMAGE_IMPLEMENTATION :
+   define JPEG_DECODER_IMPLEMENTATION there and include this header after stb_image.h. */
+namespace JpegDecoder
+{
+	/* Same as stbi_load_from_memory(data, size, width, height, channels, 0), never flipped. pool may be a pool
+	   the caller runs on, or nullptr to decode the segments on the calling thread. parallel, if given,
+	   tells whether the restart intervals were used. Free the pixels with stbi_image_free(). */
+	unsigned char* load(const unsigned char* data, size_t size, int* width, int* height, int* channels, ThreadPool* pool,
+		bool* parallel = nullptr);
+}
+
+#endif
+
+#ifdef JPEG_DECODER_IMPLEMENTATION
+#ifndef JPEG_DECODER_IMPLEMENTED
+#define JPEG_DECODER_IMPLEMENTED
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#error "JpegDecoder : include stb_image.h with STB_IMAGE_IMPLEMENTATION before defining JPEG_DECODER_IMPLEMENTATION"
+#endif
+
+#include <limits.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace JpegDecoder
+{
+	namespace Detail
+	{
+		/* Entropy coded bytes of one restart interval, markers excluded */
+		struct Segment
+		{
+			const stbi_uc* begin;
+			const stbi_uc* end;
+		};
+
+		/* Cut the scan starting at data at each restart marker. Fails unless the markers come in order
+		   and the scan is ended by EOI, i.e. it is the only scan of the image. */
+		inline bool split(const stbi_uc* data, const stbi_uc* end, std::vector<Segment>& segments)
+		{
+			const stbi_uc* begin = data;
+			int expected = 0;
+			for (const stbi_uc* p = data; p + 1 < end; )
+			{
+				if (p[0] != 0xFF || p[1] == 0x00)
+				{
+					p += p[0] == 0xFF ? 2 : 1;		// 0xFF is stuffed with a 0 in entropy coded data
+					continue;
+				}
+				if (p[1] == 0xFF)
+				{
+					p++;		// Fill byte before a marker
+					continue;
+				}
+
+				Segment segment = { begin, p };
+				segments.push_back(segment);
+				if (!STBI__RESTART(p[1]))
+				{
+					return stbi__EOI(p[1]);
+				}
+				if (p[1] != 0xD0 + expected)
+				{
+					return false;
+				}
+				expected = (expected + 1) & 7;
+				p += 2;
+				begin = p;
+			}
+			return false;
+		}
+
+		/* MCUs in the scan : interleaved ones, or single blocks when the scan holds one component */
+		inline size_t mcuCount(const stbi__jpeg& z)
+		{
+			if (z.scan_n > 1)
+			{
+				return (size_t)z.img_mcu_x * z.img_mcu_y;
+			}
+			int n = z.order[0];
+			return (size_t)((z.img_comp[n].x + 7) >> 3) * ((z.img_comp[n].y + 7) >> 3);
+		}
+
+		/* Decode segments [first, last) into the component planes, like stbi__parse_entropy_coded_data() for
+		   baseline scans. Works on a copy of the decoder state, the tables and planes are shared : every MCU
+		   writes blocks of its own. */
+		inline bool decodeSegments(const stbi__jpeg& shared, const Segment* segments, size_t first, size_t last)
+		{
+			std::unique_ptr<stbi__jpeg> z(new stbi__jpeg(shared));
+			stbi__context s = *shared.s;
+			z->s = &s;
+
+			STBI_SIMD_ALIGN(short, data[64]);
+			size_t mcus = mcuCount(*z);
+			size_t interval = (size_t)z->restart_interval;
+			bool interleaved = z->scan_n > 1;
+			int mcusPerRow = interleaved ? z->img_mcu_x : (z->img_comp[z->order[0]].x + 7) >> 3;
+			for (size_t segment = first; segment < last; segment++)
+			{
+				s.img_buffer = (stbi_uc*)segments[segment].begin;
+				s.img_buffer_end = (stbi_uc*)segments[segment].end;
+				stbi__jpeg_reset(z.get());
+
+				size_t end = std::min(mcus, (segment + 1) * interval);
+				for (size_t mcu = segment * interval; mcu < end; mcu++)
+				{
+					int i = (int)(mcu % mcusPerRow);
+					int j = (int)(mcu / mcusPerRow);
+					for (int k = 0; k < z->scan_n; k++)
+					{
+						int n = z->order[k];
+						int h = interleaved ? z->img_comp[n].h : 1;
+						int v = interleaved ? z->img_comp[n].v : 1;
+						int ha = z->img_comp[n].ha;
+						for (int y = 0; y < v; y++)
+						{
+							for (int x = 0; x < h; x++)
+							{
+								if (!stbi__jpeg_decode_block(z.get(), data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n,
+									z->dequant[z->img_comp[n].tq]))
+								{
+									return false;
+								}
+								int x2 = (i * h + x) * 8;
+								int y2 = (j * v + y) * 8;
+								z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
+							}
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		/* Upsample and color convert rows [first, last) of a 1 or 3 component image, like load_jpeg_image().
+		   The resampler state is stepped through the rows above first, which is only counting. */
+		inline void convertRows(const stbi__jpeg& z, bool isRGB, stbi_uc* output, unsigned int first, unsigned int last)
+		{
+			int components = z.s->img_n;
+			unsigned int width = z.s->img_x;
+			std::vector<stbi_uc> lineBuffers((size_t)components * (width + 3));		// Upsampling writes up to 3 texels past the row
+			std::vector<stbi_uc> lastRow((size_t)components * width + 1);				// The RGB kernel writes a 4th byte per texel
+			stbi__resample resample[3];
+			stbi_uc* rows[3] = { NULL, NULL, NULL };
+
+			for (int k = 0; k < components; k++)
+			{
+				stbi__resample& r = resample[k];
+				r.hs = z.img_h_max / z.img_comp[k].h;
+				r.vs = z.img_v_max / z.img_comp[k].v;
+				r.ystep = r.vs >> 1;
+				r.w_lores = (width + r.hs - 1) / r.hs;
+				r.ypos = 0;
+				r.line0 = r.line1 = z.img_comp[k].data;
+				if (r.hs == 1 && r.vs == 1) r.resample = resample_row_1;
+				else if (r.hs == 1 && r.vs == 2) r.resample = stbi__resample_row_v_2;
+				else if (r.hs == 2 && r.vs == 1) r.resample = stbi__resample_row_h_2;
+				else if (r.hs == 2 && r.vs == 2) r.resample = z.resample_row_hv_2_kernel;
+				else r.resample = stbi__resample_row_generic;
+			}
+
+			for (unsigned int row = 0; row < last; row++)
+			{
+				for (int k = 0; k < components; k++)
+				{
+					stbi__resample& r = resample[k];
+					if (row >= first)
+					{
+						bool bottom = r.ystep >= (r.vs >> 1);
+						rows[k] = r.resample(lineBuffers.data() + (size_t)k * (width + 3), bottom ? r.line1 : r.line0, bottom ? r.line0 : r.line1,
+							r.w_lores, r.hs);
+					}
+					if (++r.ystep >= r.vs)
+					{
+						r.ystep = 0;
+						r.line0 = r.line1;
+						if (++r.ypos < z.img_comp[k].y)
+						{
+							r.line1 += z.img_comp[k].w2;
+						}
+					}
+				}
+				if (row < first)
+				{
+					continue;
+				}
+
+				// The last row of a band goes through a copy so its 4th byte doesn't land on the next band
+				stbi_uc* target = output + (size_t)components * width * row;
+				stbi_uc* out = row + 1 == last ? lastRow.data() : target;
+				if (components == 1)
+				{
+					memcpy(out, rows[0], width);
+				}
+				else if (isRGB)
+				{
+					for (unsigned int i = 0; i < width; i++)
+					{
+						out[3 * i] = rows[0][i];
+						out[3 * i + 1] = rows[1][i];
+						out[3 * i + 2] = rows[2][i];
+					}
+				}
+				else
+				{
+					z.YCbCr_to_RGB_kernel(out, rows[0], rows[1], rows[2], (int)width, 3);
+				}
+				if (out != target)
+				{
+					memcpy(target, out, (size_t)components * width);
+				}
+			}
+		}
+
+		/* On the pool and the calling thread, or the calling thread alone */
+		inline void forRange(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+		{
+			if (pool)
+			{
+				pool->parallelFor(count, grain, body);
+			}
+			else
+			{
+				body(0, count);
+			}
+		}
+
+		/* nullptr whenever the file isn't a single scan baseline JPEG with restart markers, see load() */
+		inline unsigned char* loadIntervals(const unsigned char* data, int size, int* width, int* height, int* channels, ThreadPool* pool)
+		{
+			if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+			{
+				return nullptr;
+			}
+
+			stbi__context s;
+			stbi__start_mem(&s, data, size);
+			s.img_n = 0;		// Makes stbi__cleanup_jpeg() safe before the frame header
+			std::unique_ptr<stbi__jpeg> z(new stbi__jpeg);
+			z->s = &s;
+			stbi__setup_jpeg(z.get());
+			for (int m = 0; m < 4; m++)
+			{
+				z->img_comp[m].raw_data = NULL;
+				z->img_comp[m].raw_coeff = NULL;
+				z->img_comp[m].linebuf = NULL;
+			}
+			z->restart_interval = 0;
+
+			struct Cleanup
+			{
+				stbi__jpeg* z;
+				~Cleanup() { stbi__cleanup_jpeg(z); }
+			} cleanup = { z.get() };
+
+			// Tables and restart interval come before the first scan
+			if (!stbi__decode_jpeg_header(z.get(), STBI__SCAN_load) || z->progressive)
+			{
+				return nullptr;
+			}
+			int marker = stbi__get_marker(z.get());
+			while (!stbi__SOS(marker))
+			{
+				if (marker == STBI__MARKER_none || stbi__EOI(marker) || stbi__DNL(marker) || !stbi__process_marker(z.get(), marker))
+				{
+					return nullptr;
+				}
+				marker = stbi__get_marker(z.get());
+			}
+			if (!stbi__process_scan_header(z.get()) || z->restart_interval == 0 || z->scan_n != s.img_n || (s.img_n != 1 && s.img_n != 3))
+			{
+				return nullptr;
+			}
+
+			std::vector<Segment> segments;
+			size_t intervals = (mcuCount(*z) + z->restart_interval - 1) / z->restart_interval;
+			if (!split(s.img_buffer, s.img_buffer_end, segments) || segments.size() != intervals || intervals < 2)
+			{
+				return nullptr;
+			}
+
+			// A few chunks per thread so one slow segment doesn't hold the others back
+			size_t threads = pool ? pool->size() + 1 : 1;
+			std::atomic<bool> failed(false);
+			forRange(pool, segments.size(), std::max(segments.size() / (threads * 4), (size_t)1), [&](size_t first, size_t last)
+			{
+				if (!decodeSegments(*z, segments.data(), first, last))
+				{
+					failed = true;
+				}
+			});
+			if (failed)
+			{
+				return nullptr;		// stb decodes what it can of a corrupt file, leave it to it
+			}
+
+			stbi_uc* output = (stbi_uc*)stbi__malloc_mad3(s.img_n, s.img_x, s.img_y, 1);
+			if (!output)
+			{
+				return nullptr;
+			}
+			bool isRGB = s.img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+			forRange(pool, s.img_y, std::max(s.img_y / (threads * 4), (size_t)16), [&](size_t first, size_t last)
+			{
+				convertRows(*z, isRGB, output, (unsigned int)first, (unsigned int)last);
+			});
+
+			*width = (int)s.img_x;
+			*height = (int)s.img_y;
+			*channels = s.img_n;
+			return output;
+		}
+	}
+
+	unsigned char* load(const unsigned char* data, size_t size, int* width, int* height, int* channels, ThreadPool* pool, bool* parallel)
+	{
+		if (parallel)
+		{
+			*parallel = false;
+		}
+		if (size > INT_MAX)
+		{
+			return stbi__errpuc("too large", "Image too large to decode");
+		}
+
+		unsigned char* pixels = Detail::loadIntervals(data, (int)size, width, height, channels, pool);
+		if (pixels)
+		{
+			if (parallel)
+			{
+				*parallel = true;
+			}
+			return pixels;
+		}
+		return stbi_load_from_memory(data, (int)size, width, height, channels, 0);
+	}
+}
+
+#endif
+#endif
@@ -0,0 +1,107 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+/* Bounded lock-free queue, any number of producers and consumers (Vyukov's ring of sequenced cells).
+   push() and pop() never block : they return false when the ring is full or empty. */
+template <typename T>
+class MPMCQueue
+{
+public:
+	/* capacity is rounded up to a power of two */
+	explicit MPMCQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		mask = size - 1;
+		cells.reset(new Cell[size]);
+		for (size_t i = 0; i < size; i++)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueuePos.store(0, std::memory_order_relaxed);
+		dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	bool push(const T& value)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+			if (diff == 0)
+			{
+				// The cell is free for this lap, claim it
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = value;
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;		// Full : the consumer of the previous lap hasn't taken the cell yet
+			}
+			else
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(T& value)
+	{
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+			if (diff == 0)
+			{
+				if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					value = cell.value;
+					cell.sequence.store(pos + mask + 1, std::memory_order_release);		// Free for the next lap
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;		// Empty
+			}
+			else
+			{
+				pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Each position on its own cache line so producers and consumers don't false share
+	alignas(64) std::atomic<size_t> enqueuePos;
+	alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+#endif
@@ -0,0 +1,559 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,			// 2x2 average
+	MIP_FILTER_KAISER		// 6x6 Kaiser windowed sinc, keeps small levels sharper than the box
+};
+
+struct MipOptions
+{
+	MipFilter filter;
+	bool srgb;				// Color is sRGB encoded : averaged in linear space, so levels don't get darker (3 or 4 channels)
+	bool alphaWeighted;		// Color weighted by alpha, so transparent texels don't bleed their color into edges (4 channels)
+
+	MipOptions()
+		: filter(MIP_FILTER_BOX), srgb(false), alphaWeighted(false)
+	{
+	}
+};
+
+/* One level of a chain, offset and size in bytes inside the chain buffer */
+struct MipLevel
+{
+	size_t offset;
+	size_t size;
+	int width;
+	int height;
+};
+
+/* CPU mip chain generation. The plain box filter runs on 8-bit texels with SSE2, or AVX2 when the CPU has it;
+   sRGB, alpha weighting and the Kaiser filter work on float texels kept across levels, so rounding doesn't pile up.
+   Rows of a level are split across the pool when one is given. */
+class MipGenerator
+{
+public:
+	explicit MipGenerator(ThreadPool* pool = nullptr)
+		: pool(pool)
+	{
+	}
+
+	/* Levels down to 1x1, halving each size and flooring like GL does */
+	static int levelCount(int width, int height)
+	{
+		int levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	/* Build the chain of tightly packed pixels, level 0 included, into chain and describe it in levels */
+	void generate(const unsigned char* pixels, int width, int height, int channels, const MipOptions& options,
+		std::vector<unsigned char>& chain, std::vector<MipLevel>& levels, int maxLevels = 16) const
+	{
+		levels.clear();
+		int count = std::min(levelCount(width, height), std::max(maxLevels, 1));
+
+		size_t total = 0;
+		for (int level = 0, w = width, h = height; level < count; level++)
+		{
+			MipLevel info = { total, (size_t)w * h * channels, w, h };
+			levels.push_back(info);
+			total += info.size;
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+		chain.resize(total);
+		memcpy(chain.data(), pixels, levels[0].size);
+		if (count == 1)
+		{
+			return;
+		}
+
+		bool srgb = options.srgb && channels >= 3;
+		bool alphaWeighted = options.alphaWeighted && channels == 4;
+		if (options.filter == MIP_FILTER_BOX && !srgb && !alphaWeighted)
+		{
+			for (int level = 1; level < count; level++)
+			{
+				const MipLevel& source = levels[level - 1];
+				boxBytes(chain.data() + source.offset, source.width, source.height, channels, chain.data() + levels[level].offset);
+			}
+			return;
+		}
+
+		std::vector<float> current, next;
+		toFloat(pixels, width, height, channels, srgb, alphaWeighted, current);
+		for (int level = 1; level < count; level++)
+		{
+			const MipLevel& source = levels[level - 1];
+			const MipLevel& destination = levels[level];
+			next.resize((size_t)destination.width * destination.height * 4);
+			if (options.filter == MIP_FILTER_KAISER)
+			{
+				kaiserFloat(current.data(), source.width, source.height, next.data(), destination.width, destination.height);
+			}
+			else
+			{
+				boxFloat(current.data(), source.width, source.height, next.data(), destination.width, destination.height);
+			}
+			fromFloat(next.data(), destination.width, destination.height, channels, srgb, alphaWeighted, chain.data() + destination.offset);
+			current.swap(next);
+		}
+	}
+
+	/* Halve the image until both sizes are at most maxSize, with the same filters as the chain. Steps are powers of two,
+	   so a 3000 texels wide image capped at 2048 ends up 1500 wide. Returns false and leaves out alone if it already fits. */
+	bool downscale(const unsigned char* pixels, int& width, int& height, int channels, const MipOptions& options, int maxSize,
+		std::vector<unsigned char>& out) const
+	{
+		int steps = 0;
+		int w = width, h = height;
+		while (maxSize > 0 && (w > maxSize || h > maxSize))
+		{
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+			steps++;
+		}
+		if (steps == 0)
+		{
+			return false;
+		}
+
+		bool srgb = options.srgb && channels >= 3;
+		bool alphaWeighted = options.alphaWeighted && channels == 4;
+		w = width;
+		h = height;
+		if (options.filter == MIP_FILTER_BOX && !srgb && !alphaWeighted)
+		{
+			// Ping-pong between two buffers, picked so the last step lands in out
+			std::vector<unsigned char> scratch;
+			const unsigned char* source = pixels;
+			for (int step = 0; step < steps; step++)
+			{
+				int halfWidth = w > 1 ? w / 2 : 1;
+				int halfHeight = h > 1 ? h / 2 : 1;
+				std::vector<unsigned char>& target = (steps - 1 - step) % 2 == 0 ? out : scratch;
+				target.resize((size_t)halfWidth * halfHeight * channels);
+				boxBytes(source, w, h, channels, target.data());
+				source = target.data();
+				w = halfWidth;
+				h = halfHeight;
+			}
+		}
+		else
+		{
+			std::vector<float> current, next;
+			toFloat(pixels, w, h, channels, srgb, alphaWeighted, current);
+			for (int step = 0; step < steps; step++)
+			{
+				int halfWidth = w > 1 ? w / 2 : 1;
+				int halfHeight = h > 1 ? h / 2 : 1;
+				next.resize((size_t)halfWidth * halfHeight * 4);
+				if (options.filter == MIP_FILTER_KAISER)
+				{
+					kaiserFloat(current.data(), w, h, next.data(), halfWidth, halfHeight);
+				}
+				else
+				{
+					boxFloat(current.data(), w, h, next.data(), halfWidth, halfHeight);
+				}
+				current.swap(next);
+				w = halfWidth;
+				h = halfHeight;
+			}
+			out.resize((size_t)w * h * channels);
+			fromFloat(current.data(), w, h, channels, srgb, alphaWeighted, out.data());
+		}
+
+		width = w;
+		height = h;
+		return true;
+	}
+
+	/* Reference 2x2 average, one texel and channel at a time. Used as the baseline of the mipmaps benchmark. */
+	static void downsampleScalar(const unsigned char* source, int width, int height, int channels, unsigned char* destination)
+	{
+		int halfWidth = width > 1 ? width / 2 : 1;
+		int halfHeight = height > 1 ? height / 2 : 1;
+		for (int y = 0; y < halfHeight; y++)
+		{
+			const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * width * channels;
+			const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+			for (int x = 0; x < halfWidth; x++)
+			{
+				int x0 = std::min(2 * x, width - 1) * channels;
+				int x1 = std::min(2 * x + 1, width - 1) * channels;
+				for (int c = 0; c < channels; c++)
+				{
+					*destination++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+				}
+			}
+		}
+	}
+
+private:
+	ThreadPool* pool;
+
+	static const int KAISER_TAPS = 6;
+
+	/* Rows [0, rows) in chunks of about 16K texels, spread on the pool if there is one */
+	void forRows(int rows, int rowTexels, const std::function<void(size_t, size_t)>& body) const
+	{
+		size_t grain = std::max((size_t)1, (size_t)16384 / (size_t)std::max(rowTexels, 1));
+		if (pool && (size_t)rows > grain)
+		{
+			pool->parallelFor((size_t)rows, grain, body);
+		}
+		else
+		{
+			body(0, (size_t)rows);
+		}
+	}
+
+	/* ===================================== 8-bit box ===================================== */
+
+	void boxBytes(const unsigned char* source, int width, int height, int channels, unsigned char* destination) const
+	{
+		int halfWidth = width > 1 ? width / 2 : 1;
+		int halfHeight = height > 1 ? height / 2 : 1;
+		if (channels != 4 || width < 2 || height < 2)
+		{
+			downsampleScalar(source, width, height, channels, destination);
+			return;
+		}
+
+		bool avx2 = Simd::hasAVX2();
+		size_t sourceRow = (size_t)width * 4;
+		forRows(halfHeight, halfWidth, [=](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; y++)
+			{
+				const unsigned char* row0 = source + 2 * y * sourceRow;
+				unsigned char* out = destination + y * halfWidth * 4;
+				int x = 0;
+#ifdef SIMD_X86
+				x = avx2 ? boxRowAVX2(row0, row0 + sourceRow, out, halfWidth) : boxRowSSE2(row0, row0 + sourceRow, out, halfWidth);
+#endif
+				boxRowTail(row0, row0 + sourceRow, out, x, halfWidth);
+			}
+		});
+	}
+
+	/* Texels [x, halfWidth) of an RGBA row, scalar */
+	static void boxRowTail(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int x, int halfWidth)
+	{
+		for (; x < halfWidth; x++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int a = 8 * x + c;
+				out[4 * x + c] = (unsigned char)((row0[a] + row0[a + 4] + row1[a] + row1[a + 4] + 2) >> 2);
+			}
+		}
+	}
+
+#ifdef SIMD_X86
+	/* 4 RGBA texels out of 8 per iteration. Returns how many texels were done. */
+	static int boxRowSSE2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int halfWidth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		int x = 0;
+		for (; x + 4 <= halfWidth; x += 4)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x + 16));
+
+			// Vertical sums in 16 bits, two texels per register
+			__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+			// Horizontal : add the neighbour texel, the low half holds the 2x2 sum
+			s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+			s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+			s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+			s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+			__m128i d01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), two), 2);
+			__m128i d23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), two), 2);
+			_mm_storeu_si128((__m128i*)(out + 4 * x), _mm_packus_epi16(d01, d23));
+		}
+		return x;
+	}
+
+	/* Same with 8 texels out of 16. Unpack and pack work per 128-bit lane, the final permute restores texel order. */
+	SIMD_TARGET_AVX2 static int boxRowAVX2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int halfWidth)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i two = _mm256_set1_epi16(2);
+		int x = 0;
+		for (; x + 8 <= halfWidth; x += 8)
+		{
+			__m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + 8 * x));
+			__m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + 8 * x + 32));
+			__m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + 8 * x));
+			__m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + 8 * x + 32));
+
+			__m256i s0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+			__m256i s1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+			__m256i s2 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+			__m256i s3 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+
+			s0 = _mm256_add_epi16(s0, _mm256_srli_si256(s0, 8));
+			s1 = _mm256_add_epi16(s1, _mm256_srli_si256(s1, 8));
+			s2 = _mm256_add_epi16(s2, _mm256_srli_si256(s2, 8));
+			s3 = _mm256_add_epi16(s3, _mm256_srli_si256(s3, 8));
+
+			__m256i first = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(s0, s1), two), 2);
+			__m256i second = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(s2, s3), two), 2);
+
+			// 64-bit blocks come out as texels 0-1, 4-5, 2-3, 6-7
+			__m256i packed = _mm256_packus_epi16(first, second);
+			_mm256_storeu_si256((__m256i*)(out + 4 * x), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+		return x;
+	}
+#endif
+
+	/* ===================================== Float path ===================================== */
+
+	/* 4 floats of one texel, with SSE when available */
+	struct Texel
+	{
+#ifdef SIMD_X86
+		__m128 v;
+
+		static Texel load(const float* p) { Texel t; t.v = _mm_loadu_ps(p); return t; }
+		static Texel zero() { Texel t; t.v = _mm_setzero_ps(); return t; }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+		void add(const Texel& o) { v = _mm_add_ps(v, o.v); }
+		void addScaled(const Texel& o, float w) { v = _mm_add_ps(v, _mm_mul_ps(o.v, _mm_set1_ps(w))); }
+		void scale(float w) { v = _mm_mul_ps(v, _mm_set1_ps(w)); }
+#else
+		float v[4];
+
+		static Texel load(const float* p) { Texel t; memcpy(t.v, p, sizeof(t.v)); return t; }
+		static Texel zero() { Texel t = { { 0.0f, 0.0f, 0.0f, 0.0f } }; return t; }
+		void store(float* p) const { memcpy(p, v, sizeof(v)); }
+		void add(const Texel& o) { for (int i = 0; i < 4; i++) v[i] += o.v[i]; }
+		void addScaled(const Texel& o, float w) { for (int i = 0; i < 4; i++) v[i] += o.v[i] * w; }
+		void scale(float w) { for (int i = 0; i < 4; i++) v[i] *= w; }
+#endif
+	};
+
+	static const float* srgbToLinear()
+	{
+		static float table[256];
+		static bool ready = [&]()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				table[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return true;
+		}();
+		(void)ready;
+		return table;
+	}
+
+	/* Linear [0, 1] quantized to 4096 steps, to 8-bit sRGB */
+	static const unsigned char* linearToSrgb()
+	{
+		static unsigned char table[4096];
+		static bool ready = [&]()
+		{
+			for (int i = 0; i < 4096; i++)
+			{
+				float l = i / 4095.0f;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+				table[i] = (unsigned char)std::min(255.0f, c * 255.0f + 0.5f);
+			}
+			return true;
+		}();
+		(void)ready;
+		return table;
+	}
+
+	/* Normalized Kaiser windowed sinc for a 2:1 reduction, taps at source texel distances -2.5 to 2.5 */
+	static const float* kaiserWeights()
+	{
+		static float weights[KAISER_TAPS];
+		static bool ready = [&]()
+		{
+			const double pi = 3.14159265358979323846;
+			const double alpha = 4.0;
+			const double radius = 3.0;
+			auto besselI0 = [](double x)
+			{
+				double sum = 1.0, term = 1.0;
+				for (int k = 1; k < 20; k++)
+				{
+					term *= (x / (2.0 * k)) * (x / (2.0 * k));
+					sum += term;
+				}
+				return sum;
+			};
+
+			double total = 0.0;
+			for (int k = 0; k < KAISER_TAPS; k++)
+			{
+				double d = k - 2.5;
+				double s = d / 2.0;		// Sinc at the destination rate
+				double sinc = fabs(s) < 1e-6 ? 1.0 : sin(pi * s) / (pi * s);
+				double t = d / radius;
+				double window = besselI0(alpha * sqrt(std::max(0.0, 1.0 - t * t))) / besselI0(alpha);
+				weights[k] = (float)(sinc * window);
+				total += weights[k];
+			}
+			for (int k = 0; k < KAISER_TAPS; k++)
+			{
+				weights[k] = (float)(weights[k] / total);
+			}
+			return true;
+		}();
+		(void)ready;
+		return weights;
+	}
+
+	/* 8-bit texels to linear RGBA floats, premultiplied by alpha if asked. Missing channels read as 0, alpha as 1. */
+	void toFloat(const unsigned char* pixels, int width, int height, int channels, bool srgb, bool alphaWeighted, std::vector<float>& out) const
+	{
+		out.resize((size_t)width * height * 4);
+		const float* linear = srgbToLinear();
+		float* result = out.data();
+		forRows(height, width, [=](size_t begin, size_t end)
+		{
+			for (size_t i = begin * width; i < end * width; i++)
+			{
+				const unsigned char* texel = pixels + i * channels;
+				float* f = result + i * 4;
+				f[0] = f[1] = f[2] = 0.0f;
+				f[3] = 1.0f;
+				for (int c = 0; c < channels; c++)
+				{
+					f[c] = (srgb && c < 3) ? linear[texel[c]] : texel[c] / 255.0f;
+				}
+				if (alphaWeighted)
+				{
+					f[0] *= f[3];
+					f[1] *= f[3];
+					f[2] *= f[3];
+				}
+			}
+		});
+	}
+
+	/* Back to 8-bit : undo the alpha weighting, then encode to sRGB */
+	void fromFloat(const float* texels, int width, int height, int channels, bool srgb, bool alphaWeighted, unsigned char* out) const
+	{
+		const unsigned char* encode = linearToSrgb();
+		forRows(height, width, [=](size_t begin, size_t end)
+		{
+			for (size_t i = begin * width; i < end * width; i++)
+			{
+				float f[4];
+				memcpy(f, texels + i * 4, sizeof(f));
+				if (alphaWeighted)
+				{
+					float inverse = f[3] > 1.0f / 1024.0f ? 1.0f / f[3] : 0.0f;
+					f[0] *= inverse;
+					f[1] *= inverse;
+					f[2] *= inverse;
+				}
+				unsigned char* texel = out + i * channels;
+				for (int c = 0; c < channels; c++)
+				{
+					float v = std::min(1.0f, std::max(0.0f, f[c]));		// The Kaiser lobes can overshoot
+					texel[c] = (srgb && c < 3) ? encode[(int)(v * 4095.0f + 0.5f)] : (unsigned char)(v * 255.0f + 0.5f);
+				}
+			}
+		});
+	}
+
+	void boxFloat(const float* source, int width, int height, float* destination, int halfWidth, int halfHeight) const
+	{
+		forRows(halfHeight, halfWidth, [=](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; y++)
+			{
+				const float* row0 = source + (size_t)std::min(2 * (int)y, height - 1) * width * 4;
+				const float* row1 = source + (size_t)std::min(2 * (int)y + 1, height - 1) * width * 4;
+				float* out = destination + y * halfWidth * 4;
+				for (int x = 0; x < halfWidth; x++)
+				{
+					int x0 = std::min(2 * x, width - 1) * 4;
+					int x1 = std::min(2 * x + 1, width - 1) * 4;
+					Texel sum = Texel::load(row0 + x0);
+					sum.add(Texel::load(row0 + x1));
+					sum.add(Texel::load(row1 + x0));
+					sum.add(Texel::load(row1 + x1));
+					sum.scale(0.25f);
+					sum.store(out + 4 * x);
+				}
+			}
+		});
+	}
+
+	/* Separable : each destination row first filters 6 source rows vertically, then the result horizontally. Edges clamp. */
+	void kaiserFloat(const float* source, int width, int height, float* destination, int halfWidth, int halfHeight) const
+	{
+		const float* weights = kaiserWeights();
+		forRows(halfHeight, halfWidth, [=](size_t begin, size_t end)
+		{
+			std::vector<float> column((size_t)width * 4);
+			for (size_t y = begin; y < end; y++)
+			{
+				const float* rows[KAISER_TAPS];
+				for (int k = 0; k < KAISER_TAPS; k++)
+				{
+					int row = std::min(std::max(2 * (int)y + k - 2, 0), height - 1);
+					rows[k] = source + (size_t)row * width * 4;
+				}
+				for (int x = 0; x < width; x++)
+				{
+					Texel sum = Texel::zero();
+					for (int k = 0; k < KAISER_TAPS; k++)
+					{
+						sum.addScaled(Texel::load(rows[k] + 4 * x), weights[k]);
+					}
+					sum.store(&column[4 * x]);
+				}
+
+				float* out = destination + y * halfWidth * 4;
+				for (int x = 0; x < halfWidth; x++)
+				{
+					Texel sum = Texel::zero();
+					for (int k = 0; k < KAISER_TAPS; k++)
+					{
+						int tap = std::min(std::max(2 * x + k - 2, 0), width - 1);
+						sum.addScaled(Texel::load(&column[4 * tap]), weights[k]);
+					}
+					sum.store(out + 4 * x);
+				}
+			}
+		});
+	}
+};
+
+#endif
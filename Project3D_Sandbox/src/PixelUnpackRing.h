@@ -0,0 +1,192 @@
+#ifndef PIXEL_UNPACK_RING_H
+#define PIXEL_UNPACK_RING_H
+
+#include <glad/glad.h>
+
+#include "Timer.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+/* Staging ring of pixel unpack buffers for texture uploads. Pixels are copied into a buffer the GPU is done with,
+   glTexSubImage2D then reads from that buffer asynchronously instead of the driver copying client memory on the spot.
+   A fence per slot tells when its buffer can be written again; the ring never waits on one. */
+class PixelUnpackRing
+{
+public:
+	unsigned long long bytes;	// Bytes staged so far
+	unsigned int uploads;
+	unsigned int stalls;		// Times every slot was still in use, the caller retried later
+	double stagingMs;			// CPU time spent mapping and copying into the slots
+
+	/* Slots start at slotSize bytes and grow to the largest upload they receive */
+	explicit PixelUnpackRing(unsigned int slotCount = 4, size_t slotSize = 4 << 20)
+		: bytes(0), uploads(0), stalls(0), stagingMs(0.0), next(0)
+	{
+		slots.resize(slotCount > 0 ? slotCount : 1);
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			glGenBuffers(1, &slots[i].buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[i].buffer);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)slotSize, NULL, GL_STREAM_DRAW);
+			slots[i].capacity = slotSize;
+			slots[i].fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	~PixelUnpackRing()
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].fence)
+			{
+				glDeleteSync(slots[i].fence);
+			}
+			glDeleteBuffers(1, &slots[i].buffer);
+		}
+	}
+
+	PixelUnpackRing(const PixelUnpackRing&) = delete;
+	PixelUnpackRing& operator=(const PixelUnpackRing&) = delete;
+
+	/* True if the next slot can take an upload now. Slots are used in order so only that one needs checking. */
+	bool hasFreeSlot()
+	{
+		Slot& slot = slots[next];
+		if (!slot.fence)
+		{
+			return true;
+		}
+
+		// Zero timeout : only asks, the flush makes sure the fence eventually signals
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			return false;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		return true;
+	}
+
+	/* Stage size bytes of pixels and update a rectangle of the texture bound to target from them.
+	   With flipRowBytes, rows of that size are staged in reverse order, which flips the rectangle for free.
+	   Returns false without touching anything if no slot is free yet, try again next frame. */
+	bool upload(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const void* pixels, size_t size, size_t flipRowBytes = 0)
+	{
+		return stage(pixels, size, flipRowBytes, [=](const void* source)
+		{
+			glTexSubImage2D(target, level, x, y, width, height, format, type, source);
+		});
+	}
+
+	/* Same for one layer of a GL_TEXTURE_2D_ARRAY */
+	bool uploadLayer(GLenum target, GLint level, GLint x, GLint y, GLint layer, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const void* pixels, size_t size)
+	{
+		return stage(pixels, size, 0, [=](const void* source)
+		{
+			glTexSubImage3D(target, level, x, y, layer, width, height, 1, format, type, source);
+		});
+	}
+
+	/* Same for block compressed data : x, y and the size must be multiples of the block size, except at the level edges */
+	bool uploadCompressed(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+		GLenum internalFormat, const void* blocks, size_t size)
+	{
+		return stage(blocks, size, 0, [=](const void* source)
+		{
+			glCompressedTexSubImage2D(target, level, x, y, width, height, internalFormat, (GLsizei)size, source);
+		});
+	}
+
+	/* Staging throughput in MB/s, copy time only */
+	double throughput() const
+	{
+		return stagingMs > 0.0 ? (bytes / (1024.0 * 1024.0)) / (stagingMs / 1000.0) : 0.0;
+	}
+
+private:
+	/* Copy size bytes into the next slot and call issue with the offset to read them from, or with data itself
+	   if the slot can't be mapped. Rows of flipRowBytes are copied last first. */
+	template<typename Issue>
+	bool stage(const void* data, size_t size, size_t flipRowBytes, Issue issue)
+	{
+		if (!hasFreeSlot())
+		{
+			stalls++;
+			return false;
+		}
+
+		Timer timer;
+		Slot& slot = slots[next];
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		if (size > slot.capacity)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+			slot.capacity = size;
+		}
+
+		// The fence already proved the GPU is done with this slot, no need for the driver to synchronize again
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!staging)
+		{
+			// Mapping failed, fall back to a client memory upload rather than dropping the image
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (flipRowBytes > 0)
+			{
+				std::vector<unsigned char> flipped(size);
+				copy(flipped.data(), data, size, flipRowBytes);
+				issue(flipped.data());
+			}
+			else
+			{
+				issue(data);
+			}
+			stagingMs += timer.elapsedMs();
+			return true;
+		}
+		copy(staging, data, size, flipRowBytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		issue((const void*)0);		// Offset 0 in the bound buffer
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);		// Other uploads read client memory again
+
+		next = (next + 1) % slots.size();
+		bytes += size;
+		uploads++;
+		stagingMs += timer.elapsedMs();
+		return true;
+	}
+
+	static void copy(void* destination, const void* source, size_t size, size_t flipRowBytes)
+	{
+		if (flipRowBytes == 0)
+		{
+			memcpy(destination, source, size);
+			return;
+		}
+		size_t rows = size / flipRowBytes;
+		for (size_t row = 0; row < rows; row++)
+		{
+			memcpy((unsigned char*)destination + (rows - 1 - row) * flipRowBytes, (const unsigned char*)source + row * flipRowBytes, flipRowBytes);
+		}
+	}
+
+	struct Slot
+	{
+		GLuint buffer;
+		size_t capacity;
+		GLsync fence;		// Signaled once the texture upload reading this slot has completed, 0 if idle
+	};
+
+	std::vector<Slot> slots;
+	size_t next;			// Oldest slot, the next one to be reused
+};
+
+#endif
@@ -0,0 +1,437 @@
+#ifndef PNG_DECODER_H
+#define PNG_DECODER_H
+
+#include "Simd.h"
+
+#include <stb_image.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* PNG decode from memory, e.g. a MappedFile, with SIMD row unfiltering. Chunks are walked in place and a single IDAT
+   is inflated straight from the mapping, by stb_image's zlib. Rows of 3 and 4 byte pixels are then unfiltered with SSE2,
+   Paeth with SSSE3 where available; Up goes 16 bytes at a time. Sub, Avg and Paeth depend on the pixel to their left,
+   so those kernels work a pixel per iteration, which still beats stb's byte loops. 8-bit non interlaced gray, gray alpha,
+   RGB and RGBA without tRNS take this path, anything else is handed to stbi_load_from_memory() and decodes the same.
+
+   The implementation is compiled next to stb_image : define PNG_DECODER_IMPLEMENTATION in the file defining
+   STB_IMAGE_IMPLEMENTATION and include this header after stb_image.h. */
+namespace PngDecoder
+{
+	enum Filter
+	{
+		FILTER_NONE,
+		FILTER_SUB,
+		FILTER_UP,
+		FILTER_AVG,
+		FILTER_PAETH,
+		FILTER_COUNT
+	};
+
+	inline bool isPng(const unsigned char* data, size_t size)
+	{
+		static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		return size >= 8 && memcmp(data, signature, 8) == 0;
+	}
+
+	/* Same as stbi_load_from_memory(data, size, width, height, channels, 0), never flipped. handled, if given,
+	   tells whether the rows went through the kernels below rather than stb. Free the pixels with stbi_image_free(). */
+	unsigned char* load(const unsigned char* data, size_t size, int* width, int* height, int* channels, bool* handled = nullptr);
+
+	/* ===================================== Row kernels ===================================== */
+
+	inline unsigned char paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = p > a ? p - a : a - p;
+		int pb = p > b ? p - b : b - p;
+		int pc = p > c ? p - c : c - p;
+		if (pa <= pb && pa <= pc)
+		{
+			return (unsigned char)a;
+		}
+		return (unsigned char)(pb <= pc ? b : c);
+	}
+
+	/* Unfilter bytes of source into row, from byte start on. prior is the row above once unfiltered, zeros above the first. */
+	inline void unfilterRowScalar(int filter, const unsigned char* source, unsigned char* row, const unsigned char* prior,
+		size_t bytes, int bpp, size_t start = 0)
+	{
+		for (size_t i = start; i < bytes; i++)
+		{
+			int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+			int upLeft = i >= (size_t)bpp ? prior[i - bpp] : 0;
+			switch (filter)
+			{
+			case FILTER_SUB: row[i] = (unsigned char)(source[i] + left); break;
+			case FILTER_UP: row[i] = (unsigned char)(source[i] + prior[i]); break;
+			case FILTER_AVG: row[i] = (unsigned char)(source[i] + ((left + prior[i]) >> 1)); break;
+			case FILTER_PAETH: row[i] = (unsigned char)(source[i] + paeth(left, prior[i], upLeft)); break;
+			default: row[i] = source[i]; break;
+			}
+		}
+	}
+
+#ifdef SIMD_X86
+	/* One pixel in the low bytes of a register */
+	template<int bpp>
+	inline __m128i loadPixel(const unsigned char* pixel)
+	{
+		int value;
+		memcpy(&value, pixel, 4);
+		return _mm_cvtsi32_si128(value);
+	}
+
+	template<int bpp>
+	inline void storePixel(unsigned char* pixel, __m128i value)
+	{
+		int bytes = _mm_cvtsi128_si32(value);
+		memcpy(pixel, &bytes, 4);
+	}
+
+	/* 3 byte pixels are read and written as 2 + 1 bytes : 4 would overrun the row end, and a 3 byte memcpy
+	   through memory stalls every pixel on store forwarding */
+	template<>
+	inline __m128i loadPixel<3>(const unsigned char* pixel)
+	{
+		uint16_t low;
+		memcpy(&low, pixel, 2);
+		return _mm_cvtsi32_si128(low | (pixel[2] << 16));
+	}
+
+	template<>
+	inline void storePixel<3>(unsigned char* pixel, __m128i value)
+	{
+		int bytes = _mm_cvtsi128_si32(value);
+		uint16_t low = (uint16_t)bytes;
+		memcpy(pixel, &low, 2);
+		pixel[2] = (unsigned char)(bytes >> 16);
+	}
+
+	/* 16 bytes per iteration, returns how many were done */
+	inline size_t upSSE2(const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes)
+	{
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16)
+		{
+			__m128i filtered = _mm_loadu_si128((const __m128i*)(source + i));
+			__m128i above = _mm_loadu_si128((const __m128i*)(prior + i));
+			_mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(filtered, above));
+		}
+		return i;
+	}
+
+	template<int bpp>
+	inline void subSSE2(const unsigned char* source, unsigned char* row, size_t bytes)
+	{
+		__m128i left = _mm_setzero_si128();
+		for (size_t i = 0; i < bytes; i += bpp)
+		{
+			left = _mm_add_epi8(loadPixel<bpp>(source + i), left);
+			storePixel<bpp>(row + i, left);
+		}
+	}
+
+	/* pavgb rounds up, the low bit both sides had in odd sums is taken back off */
+	template<int bpp>
+	inline void avgSSE2(const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes)
+	{
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i left = _mm_setzero_si128();
+		for (size_t i = 0; i < bytes; i += bpp)
+		{
+			__m128i above = loadPixel<bpp>(prior + i);
+			__m128i average = _mm_sub_epi8(_mm_avg_epu8(left, above), _mm_and_si128(_mm_xor_si128(left, above), one));
+			left = _mm_add_epi8(loadPixel<bpp>(source + i), average);
+			storePixel<bpp>(row + i, left);
+		}
+	}
+
+	/* Predictor among a (left), b (above) and c (above left) in 16 bits, ties going to a then b like paeth() */
+	inline __m128i paethNearest(__m128i a, __m128i b, __m128i c, __m128i pa, __m128i pb, __m128i pc)
+	{
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		__m128i isA = _mm_cmpeq_epi16(smallest, pa);
+		__m128i isB = _mm_andnot_si128(isA, _mm_cmpeq_epi16(smallest, pb));
+		__m128i isC = _mm_andnot_si128(_mm_or_si128(isA, isB), _mm_set1_epi16(-1));
+		return _mm_or_si128(_mm_or_si128(_mm_and_si128(isA, a), _mm_and_si128(isB, b)), _mm_and_si128(isC, c));
+	}
+
+	/* With p = a + b - c : |p - a| = |b - c|, |p - b| = |a - c|, |p - c| = |b - c + a - c| */
+	template<int bpp>
+	inline void paethSSE2(const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i a = zero, c = zero;
+		for (size_t i = 0; i < bytes; i += bpp)
+		{
+			__m128i b = _mm_unpacklo_epi8(loadPixel<bpp>(prior + i), zero);
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = _mm_add_epi16(pa, pb);
+			pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+			pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+			pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+			__m128i nearest = paethNearest(a, b, c, pa, pb, pc);
+			__m128i pixel = _mm_add_epi8(loadPixel<bpp>(source + i), _mm_packus_epi16(nearest, zero));
+			storePixel<bpp>(row + i, pixel);
+			a = _mm_unpacklo_epi8(pixel, zero);
+			c = b;
+		}
+	}
+
+	/* Same with pabsw */
+	template<int bpp>
+	SIMD_TARGET_SSSE3 inline void paethSSSE3(const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i a = zero, c = zero;
+		for (size_t i = 0; i < bytes; i += bpp)
+		{
+			__m128i b = _mm_unpacklo_epi8(loadPixel<bpp>(prior + i), zero);
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+			pa = _mm_abs_epi16(pa);
+			pb = _mm_abs_epi16(pb);
+			__m128i nearest = paethNearest(a, b, c, pa, pb, pc);
+			__m128i pixel = _mm_add_epi8(loadPixel<bpp>(source + i), _mm_packus_epi16(nearest, zero));
+			storePixel<bpp>(row + i, pixel);
+			a = _mm_unpacklo_epi8(pixel, zero);
+			c = b;
+		}
+	}
+
+	template<int bpp>
+	inline void unfilterPixelsSIMD(int filter, const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes)
+	{
+		switch (filter)
+		{
+		case FILTER_SUB: subSSE2<bpp>(source, row, bytes); break;
+		case FILTER_AVG: avgSSE2<bpp>(source, row, prior, bytes); break;
+		default:
+			if (Simd::hasSSSE3())
+			{
+				paethSSSE3<bpp>(source, row, prior, bytes);
+			}
+			else
+			{
+				paethSSE2<bpp>(source, row, prior, bytes);
+			}
+			break;
+		}
+	}
+#endif
+
+	/* Unfilter one row of bytes with bpp bytes per pixel. Returns false for an unknown filter type. */
+	inline bool unfilterRow(int filter, const unsigned char* source, unsigned char* row, const unsigned char* prior, size_t bytes, int bpp)
+	{
+		if (filter < 0 || filter >= FILTER_COUNT)
+		{
+			return false;
+		}
+		if (filter == FILTER_NONE)
+		{
+			memcpy(row, source, bytes);
+			return true;
+		}
+
+		size_t done = 0;
+#ifdef SIMD_X86
+		if (filter == FILTER_UP)
+		{
+			done = upSSE2(source, row, prior, bytes);
+		}
+		else if (bpp == 3)
+		{
+			unfilterPixelsSIMD<3>(filter, source, row, prior, bytes);
+			return true;
+		}
+		else if (bpp == 4)
+		{
+			unfilterPixelsSIMD<4>(filter, source, row, prior, bytes);
+			return true;
+		}
+#endif
+		unfilterRowScalar(filter, source, row, prior, bytes, bpp, done);
+		return true;
+	}
+}
+
+#endif
+
+#ifdef PNG_DECODER_IMPLEMENTATION
+#ifndef PNG_DECODER_IMPLEMENTED
+#define PNG_DECODER_IMPLEMENTED
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#error "PngDecoder : include stb_image.h with STB_IMAGE_IMPLEMENTATION before defining PNG_DECODER_IMPLEMENTATION"
+#endif
+
+#include <limits.h>
+#include <vector>
+
+namespace PngDecoder
+{
+	namespace Detail
+	{
+		inline uint32_t bigEndian32(const unsigned char* bytes)
+		{
+			return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+		}
+
+		inline uint32_t chunkType(char a, char b, char c, char d)
+		{
+			return ((uint32_t)(unsigned char)a << 24) | ((uint32_t)(unsigned char)b << 16) | ((uint32_t)(unsigned char)c << 8) | (unsigned char)d;
+		}
+
+		/* nullptr for anything but the images described above, and for anything stb would reject : it gets to say why */
+		inline unsigned char* loadRows(const unsigned char* data, size_t size, int* width, int* height, int* channels)
+		{
+			if (!isPng(data, size) || size > INT_MAX)
+			{
+				return nullptr;
+			}
+
+			uint32_t imageWidth = 0, imageHeight = 0;
+			int components = 0;
+			std::vector<const unsigned char*> idat;		// Body of each IDAT chunk, then its end
+			std::vector<uint32_t> idatSizes;
+			size_t compressedSize = 0;
+			const unsigned char* end = data + size;
+			const unsigned char* chunk = data + 8;
+			for (;;)
+			{
+				if (end - chunk < 12)
+				{
+					return nullptr;
+				}
+				uint32_t length = bigEndian32(chunk);
+				uint32_t type = bigEndian32(chunk + 4);
+				const unsigned char* body = chunk + 8;
+				if (length > (size_t)(end - body) - 4)
+				{
+					return nullptr;
+				}
+
+				if (type == chunkType('I', 'H', 'D', 'R'))
+				{
+					static const int componentsOf[7] = { 1, 0, 3, 0, 2, 0, 4 };		// By color type, 0 for palettes and unknown types
+					if (components != 0 || length != 13 || body[8] != 8 || body[9] > 6 || body[10] != 0 || body[11] != 0 || body[12] != 0)
+					{
+						return nullptr;
+					}
+					imageWidth = bigEndian32(body);
+					imageHeight = bigEndian32(body + 4);
+					components = componentsOf[body[9]];
+					if (components == 0 || imageWidth == 0 || imageHeight == 0 || imageWidth > (1 << 24) || imageHeight > (1 << 24)
+						|| (1 << 30) / imageWidth / components < imageHeight)
+					{
+						return nullptr;
+					}
+				}
+				else if (components == 0)
+				{
+					return nullptr;		// IHDR comes first
+				}
+				else if (type == chunkType('I', 'D', 'A', 'T'))
+				{
+					idat.push_back(body);
+					idatSizes.push_back(length);
+					compressedSize += length;
+				}
+				else if (type == chunkType('I', 'E', 'N', 'D'))
+				{
+					break;
+				}
+				else if (type == chunkType('t', 'R', 'N', 'S') || (type == chunkType('P', 'L', 'T', 'E') && components < 3))
+				{
+					return nullptr;		// Adds an alpha channel, or a palette on gray
+				}
+				else if (!(chunk[4] & 0x20) && type != chunkType('P', 'L', 'T', 'E'))
+				{
+					return nullptr;		// Unknown critical chunk, e.g. CgBI
+				}
+				chunk = body + length + 4;		// Past the CRC, which stb doesn't check either
+			}
+			if (idat.empty() || compressedSize > INT_MAX)
+			{
+				return nullptr;
+			}
+
+			// Straight from the mapping unless the stream is split over several chunks
+			std::vector<unsigned char> joined;
+			const unsigned char* compressed = idat[0];
+			if (idat.size() > 1)
+			{
+				joined.reserve(compressedSize);
+				for (size_t i = 0; i < idat.size(); i++)
+				{
+					joined.insert(joined.end(), idat[i], idat[i] + idatSizes[i]);
+				}
+				compressed = joined.data();
+			}
+
+			size_t rowBytes = (size_t)imageWidth * components;
+			size_t rawSize = (rowBytes + 1) * imageHeight;		// A filter type byte before each row
+			int rawLength = 0;
+			unsigned char* raw = (unsigned char*)stbi_zlib_decode_malloc_guesssize_headerflag((const char*)compressed, (int)compressedSize,
+				(int)rawSize, &rawLength, 1);
+			if (!raw || (size_t)rawLength < rawSize)
+			{
+				STBI_FREE(raw);
+				return nullptr;
+			}
+
+			unsigned char* pixels = (unsigned char*)stbi__malloc_mad3((int)imageWidth, (int)imageHeight, components, 0);
+			std::vector<unsigned char> zeros(pixels ? rowBytes : 0, 0);
+			for (uint32_t y = 0; pixels && y < imageHeight; y++)
+			{
+				const unsigned char* source = raw + y * (rowBytes + 1);
+				unsigned char* row = pixels + y * rowBytes;
+				if (!unfilterRow(source[0], source + 1, row, y > 0 ? row - rowBytes : zeros.data(), rowBytes, components))
+				{
+					STBI_FREE(pixels);
+					pixels = nullptr;
+				}
+			}
+			STBI_FREE(raw);
+			if (!pixels)
+			{
+				return nullptr;
+			}
+
+			*width = (int)imageWidth;
+			*height = (int)imageHeight;
+			*channels = components;
+			return pixels;
+		}
+	}
+
+	unsigned char* load(const unsigned char* data, size_t size, int* width, int* height, int* channels, bool* handled)
+	{
+		if (handled)
+		{
+			*handled = false;
+		}
+		if (size > INT_MAX)
+		{
+			return stbi__errpuc("too large", "Image too large to decode");
+		}
+
+		unsigned char* pixels = Detail::loadRows(data, size, width, height, channels);
+		if (pixels)
+		{
+			if (handled)
+			{
+				*handled = true;
+			}
+			return pixels;
+		}
+		return stbi_load_from_memory(data, (int)size, width, height, channels, 0);
+	}
+}
+
+#endif
+#endif
@@ -0,0 +1,175 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Hash.h"
+#include "ShaderSource.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/* On-disk cache of linked programs, keyed by the hash of the shader sources and of the driver strings.
+   A binary is only valid for the exact driver that produced it, so any driver update misses the cache. */
+class ProgramBinaryCache
+{
+public:
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int rejected;		// Binaries found on disk but refused by the driver
+
+	explicit ProgramBinaryCache(const char* directory = "./ShaderCache")
+		: hits(0), misses(0), rejected(0), directory(directory)
+	{
+		const char* vendor = (const char*)glGetString(GL_VENDOR);
+		const char* renderer = (const char*)glGetString(GL_RENDERER);
+		const char* version = (const char*)glGetString(GL_VERSION);
+		driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+
+#ifdef _WIN32
+		_mkdir(directory);
+#else
+		mkdir(directory, 0755);
+#endif
+	}
+
+	bool isEnabled() const
+	{
+		return GLExtensions::get().programBinary;
+	}
+
+	/* Key of a program built from these sources on the current driver */
+	uint64_t key(const ShaderSource& vertexCode, const ShaderSource& fragmentCode) const
+	{
+		uint64_t hash = fnv1a64(driver.data(), driver.size());
+		hash = vertexCode.hash(hash);
+		hash = fnv1a64("\0", 1, hash);		// Separator so moving code between stages changes the key
+		return fragmentCode.hash(hash);
+	}
+
+	/* Load the cached binary into program. Returns false on a miss or if the driver rejects the binary,
+	   in which case the program must be built from source. */
+	bool load(uint64_t key, GLuint program)
+	{
+		if (!isEnabled())
+		{
+			return false;
+		}
+
+		FILE* file = fopen(path(key).c_str(), "rb");
+		if (!file)
+		{
+			misses++;
+			return false;
+		}
+
+		Header header;
+		std::vector<char> binary;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1
+			&& header.magic == MAGIC && header.version == VERSION && header.key == key && header.length > 0;
+		if (valid)
+		{
+			binary.resize(header.length);
+			valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+		}
+		fclose(file);
+
+		if (valid)
+		{
+			GLExtensions::get().ProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+			GLint success = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			valid = success != 0;
+		}
+
+		if (!valid)
+		{
+			// Stale or corrupted entry, drop it so the next store replaces it
+			remove(path(key).c_str());
+			rejected++;
+			misses++;
+			return false;
+		}
+
+		hits++;
+		return true;
+	}
+
+	/* Must be called before glLinkProgram so the driver keeps a retrievable binary */
+	void prepare(GLuint program) const
+	{
+		if (isEnabled())
+		{
+			GLExtensions::get().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+	}
+
+	/* Save the binary of a successfully linked program */
+	void store(uint64_t key, GLuint program) const
+	{
+		if (!isEnabled())
+		{
+			return;
+		}
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+		{
+			return;
+		}
+
+		Header header;
+		std::vector<char> binary(length);
+		GLsizei written = 0;
+		GLExtensions::get().GetProgramBinary(program, length, &written, &header.format, binary.data());
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.key = key;
+		header.length = (uint32_t)written;
+
+		FILE* file = fopen(path(key).c_str(), "wb");
+		if (!file)
+		{
+			printf("ERROR::SHADER::BINARY_CACHE::WRITE_FAILED %s\n", path(key).c_str());
+			return;
+		}
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(binary.data(), 1, written, file);
+		fclose(file);
+	}
+
+private:
+	static const uint32_t MAGIC = 0x4E494250;		// "PBIN"
+	static const uint32_t VERSION = 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		GLenum format;
+		uint32_t length;
+	};
+
+	std::string directory;
+	std::string driver;
+
+	std::string path(uint64_t key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+		return directory + name;
+	}
+};
+
+#endif
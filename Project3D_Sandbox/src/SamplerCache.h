@@ -0,0 +1,154 @@
+#ifndef SAMPLER_CACHE_H
+#define SAMPLER_CACHE_H
+
+#include <glad/glad.h>
+
+#include "Hash.h"
+#include "TextureLoader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+/* How a texture is sampled, kept out of the texture object so one image can be sampled several ways.
+   Every member is 4 bytes and set by the constructors, so the struct hashes and compares as raw bytes. */
+struct SamplerState
+{
+	GLint wrapS;
+	GLint wrapT;
+	GLint minFilter;
+	GLint magFilter;
+	float minLod;		// GL_TEXTURE_MIN_LOD, relative to GL_TEXTURE_BASE_LEVEL, see TextureStreamer::minLod()
+	float maxLod;
+
+	/* GL defaults, except a linear min filter that works without mipmaps */
+	SamplerState()
+		: wrapS(GL_REPEAT), wrapT(GL_REPEAT), minFilter(GL_LINEAR), magFilter(GL_LINEAR), minLod(-1000.0f), maxLod(1000.0f)
+	{
+	}
+
+	/* The sampling part of the options a texture was loaded with */
+	explicit SamplerState(const TextureOptions& options)
+		: wrapS(options.wrap), wrapT(options.wrap), minFilter(options.minFilter), magFilter(options.magFilter), minLod(-1000.0f), maxLod(1000.0f)
+	{
+	}
+
+	bool operator==(const SamplerState& other) const
+	{
+		return wrapS == other.wrapS && wrapT == other.wrapT && minFilter == other.minFilter && magFilter == other.magFilter
+			&& minLod == other.minLod && maxLod == other.maxLod;
+	}
+
+	struct Hasher
+	{
+		size_t operator()(const SamplerState& state) const
+		{
+			return (size_t)fnv1a64((const char*)&state, sizeof(SamplerState));
+		}
+	};
+};
+
+static_assert(sizeof(SamplerState) == 24, "SamplerState must stay free of padding to be hashed as bytes");
+
+/* One sampler object per distinct SamplerState, created on first use and bound per texture unit.
+   Binds that wouldn't change what a unit has are skipped. Call on the GL thread, before the context goes away. */
+class SamplerCache
+{
+public:
+	unsigned int created;		// Sampler objects created
+	unsigned int binds;			// glBindSampler calls issued
+	unsigned int skipped;		// bind() calls that found the sampler already on its unit
+
+	SamplerCache()
+		: created(0), binds(0), skipped(0)
+	{
+		for (unsigned int unit = 0; unit < MAX_UNITS; unit++)
+		{
+			bound[unit] = 0;
+		}
+	}
+
+	~SamplerCache()
+	{
+		clear();
+	}
+
+	SamplerCache(const SamplerCache&) = delete;
+	SamplerCache& operator=(const SamplerCache&) = delete;
+
+	/* Sampler object for state, created the first time it is asked for */
+	GLuint get(const SamplerState& state)
+	{
+		std::unordered_map<SamplerState, GLuint, SamplerState::Hasher>::iterator found = samplers.find(state);
+		if (found != samplers.end())
+		{
+			return found->second;
+		}
+
+		GLuint sampler;
+		glGenSamplers(1, &sampler);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrapS);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrapT);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+		glSamplerParameterf(sampler, GL_TEXTURE_MIN_LOD, state.minLod);
+		glSamplerParameterf(sampler, GL_TEXTURE_MAX_LOD, state.maxLod);
+		samplers[state] = sampler;
+		created++;
+		return sampler;
+	}
+
+	/* Sample texture unit GL_TEXTURE0 + unit with state, overriding the sampling parameters of its textures */
+	void bind(unsigned int unit, const SamplerState& state)
+	{
+		bind(unit, get(state));
+	}
+
+	/* 0 goes back to the parameters of the texture itself */
+	void bind(unsigned int unit, GLuint sampler)
+	{
+		if (unit < MAX_UNITS && bound[unit] == sampler)
+		{
+			skipped++;
+			return;
+		}
+		glBindSampler(unit, sampler);
+		if (unit < MAX_UNITS)
+		{
+			bound[unit] = sampler;
+		}
+		binds++;
+	}
+
+	/* Unbind and delete every sampler, e.g. before the GL context goes away */
+	void clear()
+	{
+		for (unsigned int unit = 0; unit < MAX_UNITS; unit++)
+		{
+			if (bound[unit] != 0)
+			{
+				glBindSampler(unit, 0);
+				bound[unit] = 0;
+			}
+		}
+		for (std::unordered_map<SamplerState, GLuint, SamplerState::Hasher>::iterator it = samplers.begin(); it != samplers.end(); ++it)
+		{
+			glDeleteSamplers(1, &it->second);
+		}
+		samplers.clear();
+	}
+
+	/* Distinct sampler objects alive */
+	size_t size() const
+	{
+		return samplers.size();
+	}
+
+private:
+	static const unsigned int MAX_UNITS = 32;		// Units tracked for redundant binds, higher ones are always bound
+
+	GLuint bound[MAX_UNITS];
+	std::unordered_map<SamplerState, GLuint, SamplerState::Hasher> samplers;
+};
+
+#endif
@@ -3,102 +3,399 @@
 
 #include <glad/glad.h>	// Include glad to get all the required OpenGl headers
 
+#include "ProgramBinaryCache.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderSource.h"
+#include "Timer.h"
+#include "Uniform.h"
+
+#include <stdio.h>
+#include <string.h>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 
 class Shader
 {
 public:
 	unsigned int ID;		// Program ID
+	double buildMs;			// Time spent reading, compiling and linking in the constructor
+	bool fromBinaryCache;	// True if the program was loaded from the binary cache instead of compiled
+	std::string vertexPath;		// Source files, empty if the program was built from memory
+	std::string fragmentPath;
+	std::vector<std::string> defines;			// Feature defines injected by the preprocessor
+	std::vector<std::string> dependencies;		// Every file read to build the program, includes too
+
+	/* Uniform traffic counters, see set() and flush() */
+	struct UniformStats
+	{
+		unsigned long long uploads;		// glUniform* calls issued by flush()
+		unsigned long long avoided;		// Sets that didn't need one : same value, or overwritten before a flush
+	};
+	UniformStats uniformStats;
+
+	/* Active uniform block, bound to the shared binding point of its name */
+	struct UniformBlockInfo
+	{
+		std::string name;
+		GLuint index;
+		GLuint binding;
+		GLint size;				// Data size in bytes as laid out by the driver
+	};
+
+	/* Active uniform reflected from the program after linking */
+	struct UniformInfo
+	{
+		uint32_t hash;			// fnv1a32 of name
+		std::string name;		// Name without the "[0]" array suffix
+		GLint location;			// -1 if the uniform is no longer active after a reload
+		GLenum type;
+		GLint size;				// Array size (1 for non-array uniforms)
+		UniformValue value;		// CPU shadow of the value, also re-applied when the program is reloaded
+		bool hasValue;
+		bool dirty;				// Set since the last flush()
+	};
+
+	/* Constructor : reads and builds the shader, loading the linked program from cache when one is given */
+	Shader(const char* vertexPath, const char* fragmentPath, ProgramBinaryCache* cache = nullptr)
+		: Shader(vertexPath, fragmentPath, std::vector<std::string>(), cache)
+	{
+	}
 
-	/* Constructor : reads and builds the shader */
-	Shader(const char* vertexPath, const char* fragmentPath)
+	/* Same with a set of #define injected in both stages */
+	Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines, ProgramBinaryCache* cache = nullptr)
+		: fromBinaryCache(false), vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines), uniformStats()
 	{
+		Timer timer;
+
 		/* STEP 1: Retrieve the vertex/fragment source code from filePath */
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
+		ShaderSource vertexCode;
+		ShaderSource fragmentCode;
+		readSources(vertexPath, fragmentPath, vertexCode, fragmentCode, defines, &dependencies);
+		/* ======================== End STEP 1 ==================== */
 
-		/* Ensure ifstream objects can throw exceptions */
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		ID = glCreateProgram();
+
+		uint64_t cacheKey = 0;
+		if (cache)
 		{
-			/* Open files */
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
+			cacheKey = cache->key(vertexCode, fragmentCode);
+			fromBinaryCache = cache->load(cacheKey, ID);
+		}
 
-			/* Read file's buffer contents into streams */
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
+		if (!fromBinaryCache)
+		{
+			build(vertexCode, fragmentCode, cache, cacheKey);
+		}
 
-			/* Close file handlers */
-			vShaderFile.close();
-			fShaderFile.close();
+		reflectUniforms();
+		buildMs = timer.elapsedMs();
+	}
 
-			/* Convert stream into string */
-			vertexCode   = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-		}
-		catch (std::ifstream::failure e)
+	/* Adopt a program that was already linked elsewhere, e.g. by a ShaderLibrary batch */
+	Shader(unsigned int program, bool fromBinaryCache, double buildMs)
+		: ID(program), buildMs(buildMs), fromBinaryCache(fromBinaryCache), uniformStats()
+	{
+		reflectUniforms();
+	}
+
+	/* Read and preprocess both stage files. Prints an error and returns false if a file can't be read.
+	   Files are memory mapped (or embedded in the executable) unless mode asks for a copy. */
+	static bool readSources(const char* vertexPath, const char* fragmentPath, ShaderSource& vertexCode, ShaderSource& fragmentCode,
+		const std::vector<std::string>& defines = std::vector<std::string>(), std::vector<std::string>* dependencies = nullptr,
+		SourceFile::Mode mode = SourceFile::MAP)
+	{
+		std::vector<std::string> vertexFiles, fragmentFiles;
+		bool success = ShaderPreprocessor::process(vertexPath, defines, vertexCode, &vertexFiles, mode);
+		success = ShaderPreprocessor::process(fragmentPath, defines, fragmentCode, &fragmentFiles, mode) && success;
+
+		if (dependencies)
 		{
-			printf("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ");
+			dependencies->swap(vertexFiles);
+			dependencies->insert(dependencies->end(), fragmentFiles.begin(), fragmentFiles.end());
 		}
+		return success;
+	}
 
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		/* ======================== End STEP 1 ==================== */
+	/* Create a shader object and submit its compilation, without waiting for the result */
+	static unsigned int compileStage(GLenum type, const ShaderSource& code)
+	{
+		unsigned int shader = glCreateShader(type);
+		code.upload(shader);
+		glCompileShader(shader);
+		return shader;
+	}
 
-		/* =============== STEP 2 : Compile Shaders =============== */
-		unsigned int vertex, fragment;
+	/* Query the compile status, this waits for the driver to finish compiling */
+	static bool checkCompile(unsigned int shader, const char* stage)
+	{
 		int success;
 		char infoLog[512];
 
+		// Print compile error if any
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shader, 512, NULL, infoLog);
+			printf("ERROR::SHADER::%s::COMPILATION_FAILED\n%s\n", stage, infoLog);
+		}
+		return success != 0;
+	}
 
-		// Vertex Shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
+	/* Query the link status, this waits for the driver to finish linking */
+	static bool checkLink(unsigned int program)
+	{
+		int success;
+		char infoLog[512];
 
-		// Print compile error if any
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+		// Print linking error if any
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-			printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n", infoLog);
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
+			printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
 		}
+		return success != 0;
+	}
+	
+	/* Function to use/activate the shader, uploads the uniforms set while it wasn't bound */
+	void use()
+	{
+		glUseProgram(ID);
+		flush();
+	}
 
+	/* Upload the uniforms changed since the last flush, call it right before drawing. The program must be bound. */
+	void flush()
+	{
+		for (size_t i = 0; i < dirtySlots.size(); i++)
+		{
+			UniformInfo& info = uniforms[dirtySlots[i]];
+			info.dirty = false;
+			if (info.location < 0)
+			{
+				continue;
+			}
 
-		// Fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
+			if (info.type == GL_FLOAT)
+			{
+				glUniform1f(info.location, info.value.f);
+			}
+			else
+			{
+				glUniform1i(info.location, info.value.i);
+			}
+			uniformStats.uploads++;
+		}
+		dirtySlots.clear();
+	}
 
-		// Print compile error if any
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-		if (!success)
+	/* True if some uniform changed since the last flush() */
+	bool isDirty() const
+	{
+		return !dirtySlots.empty();
+	}
+
+	/* Utility uniform functions, checked against the GLSL type like uniform() : a mismatch prints an error and stores nothing */
+	void setBool(UniformName name, bool value)
+	{
+		set(uniform<bool>(name), value);
+	}
+
+	void setInt(UniformName name, int value)
+	{
+		set(uniform<int>(name), value);
+	}
+
+	void setFloat(UniformName name, float value)
+	{
+		set(uniform<float>(name), value);
+	}
+
+	/* Resolve a typed handle once, then update it with set() in hot loops. Handles stay valid across reload().
+	   Returns an invalid handle if the uniform is not active or its GLSL type doesn't match T. */
+	template <typename T>
+	Uniform<T> uniform(UniformName name) const
+	{
+		int slot = findSlot(name);
+		if (slot < 0)
+		{
+			return Uniform<T>();
+		}
+		if (!UniformTraits<T>::accepts(uniforms[slot].type))
+		{
+			printf("ERROR::SHADER::UNIFORM::TYPE_MISMATCH %s\n", name.str);
+			return Uniform<T>();
+		}
+		return Uniform<T>(slot);
+	}
+
+	/* Only updates the CPU shadow, the value reaches the driver at the next flush() and only if it changed.
+	   Value type must be exactly the handle type, e.g. a double literal for a Uniform<float> doesn't compile. */
+	template <typename T, typename V>
+	void set(Uniform<T> handle, V value)
+	{
+		static_assert(std::is_same<T, V>::value, "Uniform value type doesn't match the handle type");
+		if (handle.slot < 0)
 		{
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-			printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n", infoLog);
+			return;
 		}
 
+		UniformValue stored;
+		UniformTraits<T>::store(stored, value);
+
+		UniformInfo& info = uniforms[handle.slot];
+		if (info.hasValue && memcmp(&info.value, &stored, sizeof(stored)) == 0)
+		{
+			uniformStats.avoided++;
+			return;
+		}
+
+		info.value = stored;
+		info.hasValue = true;
+		if (info.dirty)
+		{
+			uniformStats.avoided++;		// The pending value is replaced before it was ever uploaded
+		}
+		else
+		{
+			info.dirty = true;
+			dirtySlots.push_back(handle.slot);
+		}
+	}
+
+	/* Location of a uniform from the reflected table, -1 if the program has no such active uniform */
+	GLint getLocation(UniformName name) const
+	{
+		int slot = findSlot(name);
+		return slot >= 0 ? uniforms[slot].location : -1;
+	}
+
+	const UniformInfo* findUniform(UniformName name) const
+	{
+		int slot = findSlot(name);
+		return slot >= 0 ? &uniforms[slot] : nullptr;
+	}
+
+	const std::vector<UniformInfo>& getUniforms() const
+	{
+		return uniforms;
+	}
+
+	const std::vector<UniformBlockInfo>& getUniformBlocks() const
+	{
+		return blocks;
+	}
+
+	const UniformBlockInfo* findUniformBlock(const std::string& name) const
+	{
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			if (blocks[i].name == name)
+			{
+				return &blocks[i];
+			}
+		}
+		return nullptr;
+	}
+
+	/* Rebuild the program from new sources. The new program only replaces ID if it links,
+	   then every uniform value set so far is flushed to it. */
+	bool reload(const ShaderSource& vertexCode, const ShaderSource& fragmentCode)
+	{
+		Timer timer;
+		unsigned int previous = ID;
 
-		// Shader Program
 		ID = glCreateProgram();
+		if (!build(vertexCode, fragmentCode, nullptr, 0))
+		{
+			glDeleteProgram(ID);
+			ID = previous;
+			return false;
+		}
+
+		GLint current = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+
+		reflectUniforms();
+		for (size_t i = 0; i < uniforms.size(); i++)
+		{
+			UniformInfo& info = uniforms[i];
+			if (info.hasValue && !info.dirty)
+			{
+				info.dirty = true;
+				dirtySlots.push_back((int)i);
+			}
+		}
+
+		// Replace the old program right away if it was bound, else the values wait for the next use()
+		if ((unsigned int)current == previous)
+		{
+			use();
+		}
+		glDeleteProgram(previous);
+
+		buildMs = timer.elapsedMs();
+		fromBinaryCache = false;
+		return true;
+	}
+
+private:
+	/* Uniform slots : indices never change once assigned, so handles survive a reload even if locations do */
+	std::vector<UniformInfo> uniforms;
+
+	/* Slots sorted by name hash for lookups by name */
+	struct UniformKey
+	{
+		uint32_t hash;
+		int slot;
+	};
+	std::vector<UniformKey> lookup;
+
+	std::vector<UniformBlockInfo> blocks;
+
+	std::vector<int> dirtySlots;		// Slots waiting for flush()
+
+	int findSlot(UniformName name) const
+	{
+		std::vector<UniformKey>::const_iterator it = std::lower_bound(lookup.begin(), lookup.end(), name.hash,
+			[](const UniformKey& key, uint32_t hash) { return key.hash < hash; });
+
+		// Names are only compared to rule out hash collisions
+		for (; it != lookup.end() && it->hash == name.hash; ++it)
+		{
+			if (uniforms[it->slot].name == name.str)
+			{
+				return it->slot;
+			}
+		}
+		return -1;
+	}
+
+	/* Compile both stages from source and link them into ID */
+	bool build(const ShaderSource& vShaderCode, const ShaderSource& fShaderCode, ProgramBinaryCache* cache, uint64_t cacheKey)
+	{
+		/* =============== STEP 2 : Compile Shaders =============== */
+		unsigned int vertex = compileStage(GL_VERTEX_SHADER, vShaderCode);
+		checkCompile(vertex, "VERTEX");
+
+		unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fShaderCode);
+		checkCompile(fragment, "FRAGMENT");
+
+		// Shader Program
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
+		if (cache)
+		{
+			cache->prepare(ID);
+		}
 		glLinkProgram(ID);
 
-		// Print linking error if any
-		glGetProgramiv(ID, GL_LINK_STATUS, &success);
-		if (!success)
+		bool linked = checkLink(ID);
+		if (linked && cache)
 		{
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
-			printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n", infoLog);
+			cache->store(cacheKey, ID);
 		}
 
 		// Delete the shaders as they're linked into our program now and no longer necessery
@@ -106,28 +403,113 @@ public:
 		glDeleteShader(fragment);
 
 		/* ======================== End STEP 2 ==================== */
-	}
-	
-	/* Function to use/activate the shader */
-	void use() const
-	{
-		glUseProgram(ID);
+		return linked;
 	}
 
-	/* Utility uniform functions */
-	void setBool(const std::string &name, bool value) const
+	/* Bind every active uniform block to the binding point shared by all programs using that block name */
+	void bindUniformBlocks()
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-	}
+		blocks.clear();
 
-	void setInt(const std::string &name, int value) const
-	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+		std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			UniformBlockInfo block;
+			glGetActiveUniformBlockName(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, nameBuffer.data());
+			glGetActiveUniformBlockiv(ID, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.size);
+
+			block.name.assign(nameBuffer.data(), length);
+			block.index = (GLuint)i;
+			block.binding = UniformBlockBindings::get(block.name);
+			glUniformBlockBinding(ID, block.index, block.binding);
+			blocks.push_back(block);
+		}
 	}
 
-	void setFloat(const std::string &name, float value) const
+	/* Enumerate the active uniforms of the linked program so setters never query the driver by name.
+	   Uniforms already known keep their slot, those gone from the program are left with location -1. */
+	void reflectUniforms()
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		bindUniformBlocks();
+
+		for (size_t i = 0; i < uniforms.size(); i++)
+		{
+			uniforms[i].location = -1;
+		}
+
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		if (count <= 0)
+		{
+			return;
+		}
+
+		std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+		size_t known = lookup.size();
+
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			UniformInfo info;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &info.size, &info.type, nameBuffer.data());
+
+			info.name.assign(nameBuffer.data(), length);
+			info.location = glGetUniformLocation(ID, info.name.c_str());
+
+			// Uniform block members have no location, they are set through buffers
+			if (info.location < 0)
+			{
+				continue;
+			}
+
+			// Arrays are reported as "name[0]", keep the base name so setters can use either form
+			std::string::size_type bracket = info.name.find('[');
+			if (bracket != std::string::npos)
+			{
+				info.name.erase(bracket);
+			}
+
+			info.hash = fnv1a32(info.name.c_str(), info.name.size());
+
+			// lookup is only sorted up to known, which is enough since a program has no duplicate names
+			int slot = -1;
+			for (std::vector<UniformKey>::const_iterator it = std::lower_bound(lookup.begin(), lookup.begin() + known, info.hash,
+				[](const UniformKey& key, uint32_t hash) { return key.hash < hash; });
+				it != lookup.begin() + known && it->hash == info.hash; ++it)
+			{
+				if (uniforms[it->slot].name == info.name)
+				{
+					slot = it->slot;
+					break;
+				}
+			}
+
+			if (slot >= 0)
+			{
+				uniforms[slot].location = info.location;
+				uniforms[slot].type = info.type;
+				uniforms[slot].size = info.size;
+			}
+			else
+			{
+				info.hasValue = false;
+				info.dirty = false;
+				UniformKey key = { info.hash, (int)uniforms.size() };
+				lookup.push_back(key);
+				uniforms.push_back(info);
+			}
+		}
+
+		std::sort(lookup.begin(), lookup.end(),
+			[](const UniformKey& a, const UniformKey& b) { return a.hash < b.hash; });
 	}
 };
 
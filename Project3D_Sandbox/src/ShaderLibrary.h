@@ -0,0 +1,232 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "ProgramBinaryCache.h"
+#include "Shader.h"
+#include "ShaderSource.h"
+#include "Timer.h"
+
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Builds many programs as one batch : every compile is submitted, then every link, and statuses are
+   only queried at the end. With KHR_parallel_shader_compile the driver works on all of them concurrently,
+   without it the driver can still overlap work that a compile-check-link-check sequence serializes. */
+class ShaderLibrary
+{
+public:
+	double buildMs;				// Time of the last build() call
+	unsigned int compiled;		// Programs linked from source by the last build()
+	unsigned int cached;		// Programs loaded from the binary cache by the last build()
+	unsigned int failed;
+
+	explicit ShaderLibrary(ProgramBinaryCache* cache = nullptr)
+		: buildMs(0.0), compiled(0), cached(0), failed(0), cache(cache)
+	{
+	}
+
+	/* Queue a program, it is only built by the next build() call */
+	void add(const std::string& name, const char* vertexPath, const char* fragmentPath,
+		const std::vector<std::string>& defines = std::vector<std::string>())
+	{
+		Pending entry;
+		entry.name = name;
+		entry.vertexPath = vertexPath;
+		entry.fragmentPath = fragmentPath;
+		entry.defines = defines;
+		pending.push_back(entry);
+	}
+
+	/* Queue a program from sources already in memory */
+	void addSource(const std::string& name, const ShaderSource& vertexCode, const ShaderSource& fragmentCode)
+	{
+		Pending entry;
+		entry.name = name;
+		entry.vertexCode = vertexCode;
+		entry.fragmentCode = fragmentCode;
+		pending.push_back(entry);
+	}
+
+	/* Build every queued program. Returns false if any of them failed to compile or link. */
+	bool build()
+	{
+		Timer timer;
+		compiled = cached = failed = 0;
+
+		/* STEP 1 : Read the sources and try the binary cache */
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Pending& entry = pending[i];
+			if (!entry.vertexPath.empty())
+			{
+				Shader::readSources(entry.vertexPath.c_str(), entry.fragmentPath.c_str(), entry.vertexCode, entry.fragmentCode,
+					entry.defines, &entry.dependencies);
+			}
+
+			entry.program = glCreateProgram();
+			entry.vertex = entry.fragment = 0;
+			entry.fromBinaryCache = false;
+			if (cache)
+			{
+				entry.cacheKey = cache->key(entry.vertexCode, entry.fragmentCode);
+				entry.fromBinaryCache = cache->load(entry.cacheKey, entry.program);
+			}
+		}
+
+		/* STEP 2 : Submit all compiles */
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Pending& entry = pending[i];
+			if (!entry.fromBinaryCache)
+			{
+				entry.vertex = Shader::compileStage(GL_VERTEX_SHADER, entry.vertexCode);
+				entry.fragment = Shader::compileStage(GL_FRAGMENT_SHADER, entry.fragmentCode);
+			}
+		}
+
+		/* STEP 3 : Submit all links, a failed compile simply makes the link fail */
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Pending& entry = pending[i];
+			if (!entry.fromBinaryCache)
+			{
+				glAttachShader(entry.program, entry.vertex);
+				glAttachShader(entry.program, entry.fragment);
+				if (cache)
+				{
+					cache->prepare(entry.program);
+				}
+				glLinkProgram(entry.program);
+			}
+		}
+
+		/* STEP 4 : Wait for the driver threads, then query statuses */
+		if (GLExtensions::get().parallelShaderCompile)
+		{
+			waitForCompletion();
+		}
+
+		bool success = true;
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Pending& entry = pending[i];
+			if (!entry.fromBinaryCache)
+			{
+				if (Shader::checkLink(entry.program))
+				{
+					if (cache)
+					{
+						cache->store(entry.cacheKey, entry.program);
+					}
+					compiled++;
+				}
+				else
+				{
+					// Only look at the stages to report which one broke the link
+					printf("ERROR::SHADER_LIBRARY::%s\n", entry.name.c_str());
+					Shader::checkCompile(entry.vertex, "VERTEX");
+					Shader::checkCompile(entry.fragment, "FRAGMENT");
+					failed++;
+					success = false;
+				}
+				glDeleteShader(entry.vertex);
+				glDeleteShader(entry.fragment);
+			}
+			else
+			{
+				cached++;
+			}
+		}
+
+		buildMs = timer.elapsedMs();
+
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Pending& entry = pending[i];
+			Shader* shader = new Shader(entry.program, entry.fromBinaryCache, buildMs);
+			shader->vertexPath = entry.vertexPath;
+			shader->fragmentPath = entry.fragmentPath;
+			shader->defines.swap(entry.defines);
+			shader->dependencies.swap(entry.dependencies);
+			shaders[entry.name] = std::unique_ptr<Shader>(shader);
+		}
+		pending.clear();
+
+		return success;
+	}
+
+	/* Shader built under this name, nullptr if there is none */
+	Shader* get(const std::string& name) const
+	{
+		std::map<std::string, std::unique_ptr<Shader> >::const_iterator it = shaders.find(name);
+		return it != shaders.end() ? it->second.get() : nullptr;
+	}
+
+	size_t size() const
+	{
+		return shaders.size();
+	}
+
+private:
+	struct Pending
+	{
+		std::string name;
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::vector<std::string> defines;
+		std::vector<std::string> dependencies;
+		ShaderSource vertexCode;
+		ShaderSource fragmentCode;
+		unsigned int vertex;
+		unsigned int fragment;
+		unsigned int program;
+		uint64_t cacheKey;
+		bool fromBinaryCache;
+	};
+
+	ProgramBinaryCache* cache;
+	std::vector<Pending> pending;
+	std::map<std::string, std::unique_ptr<Shader> > shaders;
+
+	/* Poll GL_COMPLETION_STATUS_KHR, which never blocks, until every link submitted by this batch is done */
+	void waitForCompletion() const
+	{
+		size_t done = 0;
+		std::vector<bool> complete(pending.size(), false);
+		while (done < pending.size())
+		{
+			for (size_t i = 0; i < pending.size(); i++)
+			{
+				if (complete[i])
+				{
+					continue;
+				}
+
+				GLint status = GL_TRUE;
+				if (!pending[i].fromBinaryCache)
+				{
+					glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS_KHR, &status);
+				}
+				if (status)
+				{
+					complete[i] = true;
+					done++;
+				}
+			}
+
+			if (done < pending.size())
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef SHADER_PIPELINE_H
+#define SHADER_PIPELINE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderSource.h"
+#include "Timer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Vertex and fragment stages compiled once each and mixed at bind time.
+   With ARB_separate_shader_objects every stage is linked alone into a separable program and a pair
+   only costs a pipeline object, so N vertex and M fragment variants need N + M links instead of N x M.
+   Without it stages are still compiled once, a pair is linked into a monolithic program the first time it is bound. */
+class ShaderPipelines
+{
+public:
+	/* Programs holding the uniforms of a bound pair, both point to the same Shader in monolithic mode */
+	struct Binding
+	{
+		Shader* vertex;
+		Shader* fragment;
+		GLuint pipeline;		// 0 in monolithic mode
+
+		bool isValid() const
+		{
+			return vertex && fragment;
+		}
+
+		/* Set on every stage, a stage without that uniform ignores it */
+		void setBool(UniformName name, bool value)
+		{
+			vertex->setBool(name, value);
+			if (fragment != vertex)
+			{
+				fragment->setBool(name, value);
+			}
+		}
+
+		void setInt(UniformName name, int value)
+		{
+			vertex->setInt(name, value);
+			if (fragment != vertex)
+			{
+				fragment->setInt(name, value);
+			}
+		}
+
+		void setFloat(UniformName name, float value)
+		{
+			vertex->setFloat(name, value);
+			if (fragment != vertex)
+			{
+				fragment->setFloat(name, value);
+			}
+		}
+	};
+
+	unsigned int stageCompiles;		// Shader stages compiled
+	unsigned int links;				// glLinkProgram calls, one per stage if separable, one per pair otherwise
+	unsigned int pairsCreated;		// Pairs created, a pipeline object if separable, a linked program otherwise
+	double buildMs;					// Time spent compiling and linking
+
+	/* allowSeparable = false forces the monolithic fallback, e.g. to compare both modes */
+	explicit ShaderPipelines(bool allowSeparable = true)
+		: stageCompiles(0), links(0), pairsCreated(0), buildMs(0.0),
+		separable(allowSeparable && GLExtensions::get().separateShaderObjects)
+	{
+	}
+
+	~ShaderPipelines()
+	{
+		GLExtensions& ext = GLExtensions::get();
+		for (std::map<uint64_t, Pair>::iterator it = pairs.begin(); it != pairs.end(); ++it)
+		{
+			if (it->second.pipeline)
+			{
+				ext.DeleteProgramPipelines(1, &it->second.pipeline);
+			}
+			if (it->second.program)
+			{
+				glDeleteProgram(it->second.program->ID);
+			}
+		}
+		for (size_t i = 0; i < stages.size(); i++)
+		{
+			if (stages[i].program)
+			{
+				glDeleteProgram(stages[i].program->ID);
+			}
+			if (stages[i].shader)
+			{
+				glDeleteShader(stages[i].shader);
+			}
+		}
+	}
+
+	ShaderPipelines(const ShaderPipelines&) = delete;
+	ShaderPipelines& operator=(const ShaderPipelines&) = delete;
+
+	bool isSeparable() const
+	{
+		return separable;
+	}
+
+	/* Stage index of a vertex shader file with these defines, compiled on the first call. -1 if it failed. */
+	int vertexStage(const char* path, const std::vector<std::string>& defines = std::vector<std::string>())
+	{
+		return fileStage(GL_VERTEX_SHADER, path, defines);
+	}
+
+	int fragmentStage(const char* path, const std::vector<std::string>& defines = std::vector<std::string>())
+	{
+		return fileStage(GL_FRAGMENT_SHADER, path, defines);
+	}
+
+	/* Stage from a source already in memory, key names it in the stage cache.
+	   A separable vertex source must redeclare gl_PerVertex itself, see texture.vs. */
+	int sourceStage(GLenum type, const std::string& key, const ShaderSource& code)
+	{
+		std::string cacheKey = stageKey(type, key);
+		std::map<std::string, int>::const_iterator it = stageIndex.find(cacheKey);
+		if (it != stageIndex.end())
+		{
+			return it->second;
+		}
+
+		int index = compile(type, code);
+		stageIndex[cacheKey] = index;
+		return index;
+	}
+
+	/* Make a vertex/fragment pair current, creating its pipeline or program on first use.
+	   Also flushes pending uniforms. Returns an invalid binding if either stage or the link failed. */
+	Binding bind(int vertex, int fragment)
+	{
+		Binding binding = { nullptr, nullptr, 0 };
+		if (vertex < 0 || fragment < 0 || vertex >= (int)stages.size() || fragment >= (int)stages.size())
+		{
+			return binding;
+		}
+
+		uint64_t key = ((uint64_t)(uint32_t)vertex << 32) | (uint32_t)fragment;
+		std::map<uint64_t, Pair>::iterator it = pairs.find(key);
+		if (it == pairs.end())
+		{
+			it = pairs.insert(std::make_pair(key, createPair(stages[vertex], stages[fragment]))).first;
+		}
+		Pair& pair = it->second;
+
+		if (separable)
+		{
+			if (!pair.pipeline)
+			{
+				return binding;
+			}
+			binding.vertex = stages[vertex].program.get();
+			binding.fragment = stages[fragment].program.get();
+			binding.pipeline = pair.pipeline;
+
+			// A program bound with glUseProgram takes precedence over the pipeline
+			glUseProgram(0);
+			GLExtensions::get().BindProgramPipeline(pair.pipeline);
+			flush(binding);
+		}
+		else
+		{
+			if (!pair.program)
+			{
+				return binding;
+			}
+			binding.vertex = binding.fragment = pair.program.get();
+			pair.program->use();
+		}
+		return binding;
+	}
+
+	/* Upload the uniforms changed since the last flush, call it right before drawing. The pair must be bound. */
+	void flush(const Binding& binding)
+	{
+		if (!binding.isValid())
+		{
+			return;
+		}
+		if (!separable)
+		{
+			binding.vertex->flush();
+			return;
+		}
+
+		// glUniform* target the active program of the bound pipeline, switch only when a stage has work
+		GLExtensions& ext = GLExtensions::get();
+		if (binding.vertex->isDirty())
+		{
+			ext.ActiveShaderProgram(binding.pipeline, binding.vertex->ID);
+			binding.vertex->flush();
+		}
+		if (binding.fragment->isDirty())
+		{
+			ext.ActiveShaderProgram(binding.pipeline, binding.fragment->ID);
+			binding.fragment->flush();
+		}
+	}
+
+	/* Leave pipeline mode so glUseProgram works as usual again */
+	void unbind()
+	{
+		if (separable)
+		{
+			GLExtensions::get().BindProgramPipeline(0);
+		}
+	}
+
+private:
+	struct Stage
+	{
+		GLenum type;
+		unsigned int shader;				// Monolithic mode : compiled shader kept to link pairs later
+		std::unique_ptr<Shader> program;	// Separable mode : the stage linked alone
+	};
+
+	struct Pair
+	{
+		GLuint pipeline;
+		std::unique_ptr<Shader> program;	// Monolithic mode
+	};
+
+	bool separable;
+	std::vector<Stage> stages;
+	std::map<std::string, int> stageIndex;		// Stage key to index in stages
+	std::map<uint64_t, Pair> pairs;				// (vertex << 32 | fragment) to pipeline or program
+
+	static const char* stageName(GLenum type)
+	{
+		return type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT";
+	}
+
+	static std::string stageKey(GLenum type, const std::string& name)
+	{
+		return std::string(stageName(type)) + "|" + name;
+	}
+
+	int fileStage(GLenum type, const char* path, const std::vector<std::string>& defines)
+	{
+		std::string name = path;
+		for (size_t i = 0; i < defines.size(); i++)
+		{
+			name += "|" + defines[i];
+		}
+
+		std::string cacheKey = stageKey(type, name);
+		std::map<std::string, int>::const_iterator it = stageIndex.find(cacheKey);
+		if (it != stageIndex.end())
+		{
+			return it->second;
+		}
+
+		// Separable vertex stages need gl_PerVertex redeclared, the sources do it under this define
+		std::vector<std::string> stageDefines(defines);
+		if (separable)
+		{
+			stageDefines.push_back("SEPARABLE_PROGRAM");
+		}
+
+		ShaderSource code;
+		std::vector<std::string> dependencies;
+		int index = -1;
+		if (ShaderPreprocessor::process(path, stageDefines, code, &dependencies))
+		{
+			index = compile(type, code);
+		}
+		if (index >= 0 && stages[index].program)
+		{
+			Shader& program = *stages[index].program;
+			(type == GL_VERTEX_SHADER ? program.vertexPath : program.fragmentPath) = path;
+			program.defines = defines;
+			program.dependencies.swap(dependencies);
+		}
+
+		stageIndex[cacheKey] = index;
+		return index;
+	}
+
+	int compile(GLenum type, const ShaderSource& code)
+	{
+		Timer timer;
+		unsigned int shader = Shader::compileStage(type, code);
+		stageCompiles++;
+		if (!Shader::checkCompile(shader, stageName(type)))
+		{
+			glDeleteShader(shader);
+			buildMs += timer.elapsedMs();
+			return -1;
+		}
+
+		Stage stage;
+		stage.type = type;
+		stage.shader = 0;
+
+		if (separable)
+		{
+			// What glCreateShaderProgramv does, but keeps the zero-copy segment upload of compileStage
+			unsigned int program = glCreateProgram();
+			GLExtensions::get().ProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+			glAttachShader(program, shader);
+			glLinkProgram(program);
+			links++;
+			bool linked = Shader::checkLink(program);
+			glDetachShader(program, shader);
+			glDeleteShader(shader);
+			if (!linked)
+			{
+				glDeleteProgram(program);
+				buildMs += timer.elapsedMs();
+				return -1;
+			}
+			stage.program.reset(new Shader(program, false, timer.elapsedMs()));
+		}
+		else
+		{
+			stage.shader = shader;
+		}
+
+		stages.push_back(std::move(stage));
+		buildMs += timer.elapsedMs();
+		return (int)stages.size() - 1;
+	}
+
+	Pair createPair(const Stage& vertex, const Stage& fragment)
+	{
+		Timer timer;
+		Pair pair;
+		pair.pipeline = 0;
+		pairsCreated++;
+
+		if (vertex.type != GL_VERTEX_SHADER || fragment.type != GL_FRAGMENT_SHADER)
+		{
+			printf("ERROR::SHADER_PIPELINE::STAGE_MISMATCH\n");
+			return pair;
+		}
+
+		if (separable)
+		{
+			GLExtensions& ext = GLExtensions::get();
+			ext.GenProgramPipelines(1, &pair.pipeline);
+			ext.UseProgramStages(pair.pipeline, GL_VERTEX_SHADER_BIT, vertex.program->ID);
+			ext.UseProgramStages(pair.pipeline, GL_FRAGMENT_SHADER_BIT, fragment.program->ID);
+		}
+		else
+		{
+			unsigned int program = glCreateProgram();
+			glAttachShader(program, vertex.shader);
+			glAttachShader(program, fragment.shader);
+			glLinkProgram(program);
+			links++;
+			bool linked = Shader::checkLink(program);
+			glDetachShader(program, vertex.shader);
+			glDetachShader(program, fragment.shader);
+			if (!linked)
+			{
+				glDeleteProgram(program);
+			}
+			else
+			{
+				pair.program.reset(new Shader(program, false, timer.elapsedMs()));
+			}
+		}
+
+		buildMs += timer.elapsedMs();
+		return pair;
+	}
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "ShaderSource.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Expands #include "file" directives and injects #define sets right after #version, so feature
+   permutations of one shader file can be compiled without hand-copied files.
+   The output references slices of the source files instead of copying them, only the directives
+   it generates are new text. Each file is included once, which also breaks include cycles.
+   #line directives keep compiler errors pointing at the right line, the source string number
+   is the file index in dependencies. */
+class ShaderPreprocessor
+{
+public:
+	/* Preprocess path into output. defines are "NAME" or "NAME VALUE". dependencies receives every file read,
+	   path first. Returns false if a file is missing. */
+	static bool process(const std::string& path, const std::vector<std::string>& defines, ShaderSource& output,
+		std::vector<std::string>* dependencies = nullptr, SourceFile::Mode mode = SourceFile::MAP)
+	{
+		std::vector<std::string> files;
+		output.clear();
+		bool success = expand(path, defines, output, files, true, mode);
+		if (dependencies)
+		{
+			dependencies->swap(files);
+		}
+		return success;
+	}
+
+private:
+	static std::string directoryOf(const std::string& path)
+	{
+		std::string::size_type slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	/* Skip leading blanks, true if the line then starts with directive */
+	static bool isDirective(const char* line, size_t length, const char* directive)
+	{
+		size_t start = 0;
+		while (start < length && (line[start] == ' ' || line[start] == '\t'))
+		{
+			start++;
+		}
+		size_t directiveLength = strlen(directive);
+		return length - start >= directiveLength && memcmp(line + start, directive, directiveLength) == 0;
+	}
+
+	static bool isIncluded(const std::vector<std::string>& files, const std::string& path)
+	{
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (files[i] == path)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static std::string lineDirective(int line, size_t file)
+	{
+		char directive[32];
+		snprintf(directive, sizeof(directive), "#line %d %u\n", line, (unsigned int)file);
+		return directive;
+	}
+
+	static bool expand(const std::string& path, const std::vector<std::string>& defines, ShaderSource& output,
+		std::vector<std::string>& files, bool root, SourceFile::Mode mode)
+	{
+		std::shared_ptr<SourceFile> file = SourceFile::open(path, mode);
+		if (!file)
+		{
+			printf("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ %s\n", path.c_str());
+			return false;
+		}
+
+		const size_t fileIndex = files.size();
+		files.push_back(path);
+
+		const char* source = file->data();
+		const size_t size = file->size();
+		size_t pending = 0;		// Start of the slice not appended to output yet
+		size_t position = 0;
+		int lineNumber = 0;
+		bool success = true;
+
+		while (position < size)
+		{
+			const char* newline = (const char*)memchr(source + position, '\n', size - position);
+			const size_t lineStart = position;
+			const size_t lineEnd = newline ? (size_t)(newline - source) + 1 : size;
+			const char* line = source + lineStart;
+			const size_t lineLength = lineEnd - lineStart;
+			position = lineEnd;
+			lineNumber++;
+
+			if (isDirective(line, lineLength, "#include"))
+			{
+				output.append(file, pending, lineStart - pending);
+				pending = lineEnd;
+
+				const char* open = (const char*)memchr(line, '"', lineLength);
+				const char* close = open ? (const char*)memchr(open + 1, '"', line + lineLength - open - 1) : nullptr;
+				if (!close)
+				{
+					printf("ERROR::SHADER::PREPROCESSOR::BAD_INCLUDE %s(%d)\n", path.c_str(), lineNumber);
+					success = false;
+					output.append(SourceFile::text("\n"));
+					continue;
+				}
+
+				std::string included = directoryOf(path) + std::string(open + 1, close);
+				if (isIncluded(files, included))
+				{
+					output.append(SourceFile::text("\n"));		// Keeps the line numbers right
+					continue;
+				}
+
+				output.append(SourceFile::text(lineDirective(1, files.size())));
+				success = expand(included, defines, output, files, false, mode) && success;
+				output.append(SourceFile::text(lineDirective(lineNumber + 1, fileIndex)));
+			}
+			else if (root && isDirective(line, lineLength, "#version"))
+			{
+				// Defines go right after #version, which must stay the first directive of the shader
+				output.append(file, pending, lineEnd - pending);
+				pending = lineEnd;
+
+				std::string block = newline ? "" : "\n";
+				for (size_t i = 0; i < defines.size(); i++)
+				{
+					block += "#define " + defines[i] + "\n";
+				}
+				block += lineDirective(lineNumber + 1, fileIndex);
+				output.append(SourceFile::text(block));
+			}
+		}
+
+		output.append(file, pending, size - pending);
+		if (size > 0 && source[size - 1] != '\n')
+		{
+			output.append(SourceFile::text("\n"));		// The next directive must start on its own line
+		}
+		return success;
+	}
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <glad/glad.h>
+
+#include "FileSystem.h"
+#include "Hash.h"
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef SANDBOX_EMBED_SHADERS
+#include "EmbeddedShaders.h"		// Generated from Shaders/ by tools/embed_shaders.py before the build
+#endif
+
+/* Bytes of one source file : a memory mapping, a static array embedded in the executable, or an owned copy */
+class SourceFile
+{
+public:
+	enum Mode
+	{
+		MAP,		// Embedded data when built with SANDBOX_EMBED_SHADERS, else the mapped file
+		COPY		// Read into memory from disk, for files that may be rewritten while in use (hot reload)
+	};
+
+	const char* data() const
+	{
+		return bytes;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+	/* File at path, nullptr if it can't be found. Relative paths missing from the working directory
+	   are looked up next to the executable. */
+	static std::shared_ptr<SourceFile> open(const std::string& path, Mode mode = MAP)
+	{
+#ifdef SANDBOX_EMBED_SHADERS
+		if (mode == MAP)
+		{
+			std::string key = FileSystem::normalize(path);
+			for (unsigned int i = 0; i < embeddedShaderCount; i++)
+			{
+				if (key == embeddedShaders[i].path)
+				{
+					std::shared_ptr<SourceFile> file(new SourceFile());
+					file->bytes = (const char*)embeddedShaders[i].data;
+					file->length = embeddedShaders[i].size;
+					return file;
+				}
+			}
+		}
+#endif
+		std::shared_ptr<SourceFile> file = load(path, mode);
+		if (!file && FileSystem::isRelative(path))
+		{
+			file = load(FileSystem::executableDirectory() + FileSystem::normalize(path), mode);
+		}
+		return file;
+	}
+
+	/* Text generated at runtime, e.g. #define blocks */
+	static std::shared_ptr<SourceFile> text(const std::string& content)
+	{
+		std::shared_ptr<SourceFile> file(new SourceFile());
+		file->copy = content;
+		file->bytes = file->copy.data();
+		file->length = file->copy.size();
+		return file;
+	}
+
+private:
+	const char* bytes;
+	size_t length;
+	MappedFile mapping;
+	std::string copy;
+
+	SourceFile() : bytes(nullptr), length(0)
+	{
+	}
+
+	static std::shared_ptr<SourceFile> load(const std::string& path, Mode mode)
+	{
+		std::shared_ptr<SourceFile> file(new SourceFile());
+		if (!file->mapping.open(path))
+		{
+			return nullptr;
+		}
+
+		if (mode == COPY)
+		{
+			file->copy.assign(file->mapping.data(), file->mapping.size());
+			file->mapping.close();
+			file->bytes = file->copy.data();
+			file->length = file->copy.size();
+		}
+		else
+		{
+			file->bytes = file->mapping.data();
+			file->length = file->mapping.size();
+		}
+		return file;
+	}
+};
+
+/* Source of one shader stage as a list of slices of source files, handed to glShaderSource as
+   pointer + length pairs so the preprocessor never concatenates or copies file contents. */
+class ShaderSource
+{
+public:
+	ShaderSource()
+	{
+	}
+
+	/* Single in-memory string */
+	explicit ShaderSource(const std::string& code)
+	{
+		append(SourceFile::text(code));
+	}
+
+	/* Append [offset, offset + length) of file, the whole file by default */
+	void append(const std::shared_ptr<SourceFile>& file, size_t offset = 0, size_t length = (size_t)-1)
+	{
+		if (length == (size_t)-1)
+		{
+			length = file->size() - offset;
+		}
+		if (length == 0)
+		{
+			return;
+		}
+
+		if (files.empty() || files.back() != file)
+		{
+			files.push_back(file);
+		}
+		Segment segment = { files.size() - 1, offset, length };
+		segments.push_back(segment);
+	}
+
+	void append(const ShaderSource& other)
+	{
+		for (size_t i = 0; i < other.segments.size(); i++)
+		{
+			const Segment& segment = other.segments[i];
+			append(other.files[segment.file], segment.offset, segment.length);
+		}
+	}
+
+	bool empty() const
+	{
+		return segments.empty();
+	}
+
+	void clear()
+	{
+		files.clear();
+		segments.clear();
+	}
+
+	/* Same value as hashing the concatenated source */
+	uint64_t hash(uint64_t seed = 14695981039346656037ull) const
+	{
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			seed = fnv1a64(files[segments[i].file]->data() + segments[i].offset, segments[i].length, seed);
+		}
+		return seed;
+	}
+
+	/* glShaderSource on all the slices at once */
+	void upload(GLuint shader) const
+	{
+		std::vector<const GLchar*> strings(segments.size());
+		std::vector<GLint> lengths(segments.size());
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			strings[i] = files[segments[i].file]->data() + segments[i].offset;
+			lengths[i] = (GLint)segments[i].length;
+		}
+		glShaderSource(shader, (GLsizei)segments.size(), strings.data(), lengths.data());
+	}
+
+	/* Concatenated copy, for debugging */
+	std::string str() const
+	{
+		std::string result;
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			result.append(files[segments[i].file]->data() + segments[i].offset, segments[i].length);
+		}
+		return result;
+	}
+
+private:
+	struct Segment
+	{
+		size_t file;
+		size_t offset;
+		size_t length;
+	};
+
+	std::vector<std::shared_ptr<SourceFile> > files;		// Keeps the mappings alive
+	std::vector<Segment> segments;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "ProgramBinaryCache.h"
+#include "Shader.h"
+#include "ShaderLibrary.h"
+#include "ShaderWatcher.h"
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Specialized programs of one vertex/fragment pair. Bit i of a permutation mask enables features[i]
+   as a #define, each mask is compiled the first time it is asked for and memoized. */
+class ShaderVariants
+{
+public:
+	unsigned int built;		// Variants compiled or loaded so far
+
+	/* setup runs once on every new variant, e.g. to bind sampler units */
+	ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& features,
+		ProgramBinaryCache* cache = nullptr, ShaderWatcher* watcher = nullptr,
+		std::function<void(Shader&)> setup = std::function<void(Shader&)>())
+		: built(0), vertexPath(vertexPath), fragmentPath(fragmentPath), features(features),
+		library(cache), watcher(watcher), setup(setup)
+	{
+		if (features.size() > 64)
+		{
+			printf("ERROR::SHADER_VARIANTS::TOO_MANY_FEATURES %s\n", fragmentPath);
+			this->features.resize(64);
+		}
+	}
+
+	/* Mask bit of a feature, 0 if it isn't one of ours */
+	uint64_t bit(const std::string& feature) const
+	{
+		for (size_t i = 0; i < features.size(); i++)
+		{
+			if (features[i] == feature)
+			{
+				return 1ull << i;
+			}
+		}
+		return 0;
+	}
+
+	/* Variant for this mask, compiled on first use */
+	Shader& get(uint64_t mask)
+	{
+		std::unordered_map<uint64_t, Shader*>::const_iterator it = variants.find(mask);
+		if (it != variants.end())
+		{
+			return *it->second;
+		}
+
+		std::vector<uint64_t> masks(1, mask);
+		prewarm(masks);
+		return *variants[mask];
+	}
+
+	/* Build all missing variants of masks as one batch, e.g. at load time for the variants a scene needs */
+	void prewarm(const std::vector<uint64_t>& masks)
+	{
+		std::vector<uint64_t> missing;
+		for (size_t i = 0; i < masks.size(); i++)
+		{
+			if (variants.find(masks[i]) == variants.end())
+			{
+				library.add(name(masks[i]), vertexPath.c_str(), fragmentPath.c_str(), defines(masks[i]));
+				missing.push_back(masks[i]);
+			}
+		}
+		if (missing.empty())
+		{
+			return;
+		}
+
+		library.build();
+		for (size_t i = 0; i < missing.size(); i++)
+		{
+			Shader* shader = library.get(name(missing[i]));
+			variants[missing[i]] = shader;
+			built++;
+
+			if (setup)
+			{
+				shader->use();
+				setup(*shader);
+			}
+			if (watcher)
+			{
+				watcher->watch(shader);
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		return variants.size();
+	}
+
+	/* Defines enabled by mask */
+	std::vector<std::string> defines(uint64_t mask) const
+	{
+		std::vector<std::string> enabled;
+		for (size_t i = 0; i < features.size(); i++)
+		{
+			if (mask & (1ull << i))
+			{
+				enabled.push_back(features[i]);
+			}
+		}
+		return enabled;
+	}
+
+private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::vector<std::string> features;
+
+	ShaderLibrary library;		// Owns the programs
+	ShaderWatcher* watcher;
+	std::function<void(Shader&)> setup;
+	std::unordered_map<uint64_t, Shader*> variants;
+
+	static std::string name(uint64_t mask)
+	{
+		return std::to_string((unsigned long long)mask);
+	}
+};
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include "FileSystem.h"
+#include "Shader.h"
+#include "ShaderSource.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Hot reload of shaders : a background thread watches the shader directory and every directory holding an include,
+   re-reading changed files. The render thread only picks up the new sources in poll() and recompiles them at a frame boundary.
+   Changed files are copied rather than mapped since the editor may rewrite them again at any time. */
+class ShaderWatcher
+{
+public:
+	unsigned int reloads;		// Successful reloads since start
+	unsigned int failures;		// Reloads rejected because the new program didn't compile or link
+
+	explicit ShaderWatcher(const char* directory = "./Shaders")
+		: reloads(0), failures(0), directory(directory), running(true), dependenciesChanged(false)
+	{
+		thread = std::thread(&ShaderWatcher::run, this);
+	}
+
+	~ShaderWatcher()
+	{
+		running = false;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	/* Reload shader whenever one of its source files or includes changes. The shader must outlive the watcher. */
+	void watch(Shader* shader)
+	{
+		Watched entry;
+		entry.shader = shader;
+		entry.vertexPath = shader->vertexPath;
+		entry.fragmentPath = shader->fragmentPath;
+		entry.defines = shader->defines;
+		setDependencies(entry, shader->dependencies);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		watched.push_back(entry);
+		dependenciesChanged = true;
+	}
+
+	/* Call once per frame on the GL thread. Never waits : if the watcher holds the lock, the swap happens next frame. */
+	void poll()
+	{
+		std::vector<Ready> swap;
+		{
+			std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+			if (!lock.owns_lock() || ready.empty())
+			{
+				return;
+			}
+			swap.swap(ready);
+		}
+
+		for (size_t i = 0; i < swap.size(); i++)
+		{
+			if (swap[i].shader->reload(swap[i].vertexCode, swap[i].fragmentCode))
+			{
+				swap[i].shader->dependencies.swap(swap[i].dependencies);
+				printf("Shader reloaded : %s %s (%.2f ms)\n", swap[i].shader->vertexPath.c_str(), swap[i].shader->fragmentPath.c_str(), swap[i].shader->buildMs);
+				reloads++;
+			}
+			else
+			{
+				printf("Shader reload failed, keeping the previous program : %s %s\n", swap[i].shader->vertexPath.c_str(), swap[i].shader->fragmentPath.c_str());
+				failures++;
+			}
+		}
+	}
+
+private:
+	struct Watched
+	{
+		Shader* shader;
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::vector<std::string> defines;
+		std::vector<std::string> dependencies;		// Canonical paths
+		std::vector<long long> times;				// Modification time of each dependency
+	};
+
+	/* Sources read by the watcher thread, waiting for the render thread */
+	struct Ready
+	{
+		Shader* shader;
+		ShaderSource vertexCode;
+		ShaderSource fragmentCode;
+		std::vector<std::string> dependencies;
+	};
+
+	std::string directory;
+	std::atomic<bool> running;
+	std::thread thread;
+
+	std::mutex mutex;				// Guards watched, ready and dependenciesChanged
+	std::vector<Watched> watched;
+	std::vector<Ready> ready;
+	bool dependenciesChanged;		// Tells the watcher thread to look for directories it doesn't watch yet
+
+	static std::string parentDirectory(const std::string& path)
+	{
+		std::string::size_type slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string(".") : path.substr(0, slash == 0 ? 1 : slash);
+	}
+
+	static long long modificationTime(const std::string& path)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		return _stat64(path.c_str(), &info) == 0 ? (long long)info.st_mtime : 0;
+#else
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 ? (long long)info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec : 0;
+#endif
+	}
+
+	static void setDependencies(Watched& entry, const std::vector<std::string>& dependencies)
+	{
+		entry.dependencies.resize(dependencies.size());
+		entry.times.resize(dependencies.size());
+		for (size_t i = 0; i < dependencies.size(); i++)
+		{
+			entry.dependencies[i] = FileSystem::canonical(dependencies[i]);
+			entry.times[i] = modificationTime(entry.dependencies[i]);
+		}
+	}
+
+	static bool dependsOn(const Watched& entry, const std::string& changed)
+	{
+		for (size_t i = 0; i < entry.dependencies.size(); i++)
+		{
+			if (changed == entry.dependencies[i])
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/* Directories holding a dependency of a watched shader, empty unless the dependencies changed since the last call */
+	std::vector<std::string> newDirectories()
+	{
+		std::vector<std::string> directories;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!dependenciesChanged)
+		{
+			return directories;
+		}
+		dependenciesChanged = false;
+		for (size_t i = 0; i < watched.size(); i++)
+		{
+			for (size_t j = 0; j < watched[i].dependencies.size(); j++)
+			{
+				std::string parent = parentDirectory(watched[i].dependencies[j]);
+				if (std::find(directories.begin(), directories.end(), parent) == directories.end())
+				{
+					directories.push_back(parent);
+				}
+			}
+		}
+		return directories;
+	}
+
+	/* Re-read and preprocess every watched shader using one of the changed files (canonical paths), on the watcher thread */
+	void reloadChanged(const std::vector<std::string>& changed)
+	{
+		std::vector<Watched> targets;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < watched.size(); i++)
+			{
+				for (size_t j = 0; j < changed.size(); j++)
+				{
+					if (dependsOn(watched[i], changed[j]))
+					{
+						targets.push_back(watched[i]);
+						break;
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < targets.size(); i++)
+		{
+			Ready entry;
+			entry.shader = targets[i].shader;
+			if (!Shader::readSources(targets[i].vertexPath.c_str(), targets[i].fragmentPath.c_str(), entry.vertexCode, entry.fragmentCode,
+				targets[i].defines, &entry.dependencies, SourceFile::COPY) || entry.vertexCode.empty() || entry.fragmentCode.empty())
+			{
+				continue;		// Editor still writing the file, the next event retries
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t j = 0; j < watched.size(); j++)
+			{
+				if (watched[j].shader == entry.shader)
+				{
+					setDependencies(watched[j], entry.dependencies);		// Includes may have been added or removed
+					dependenciesChanged = true;
+				}
+			}
+			for (size_t j = 0; j < ready.size(); j++)
+			{
+				if (ready[j].shader == entry.shader)
+				{
+					ready.erase(ready.begin() + j);		// Only the newest sources matter
+					break;
+				}
+			}
+			ready.push_back(entry);
+		}
+	}
+
+#ifdef _WIN32
+	/* Change notifications don't say which file changed, compare modification times instead */
+	void run()
+	{
+		std::vector<std::string> directories;
+		std::vector<HANDLE> handles;
+		watchDirectory(directory, directories, handles);
+		if (handles.empty())
+		{
+			return;
+		}
+
+		while (running)
+		{
+			std::vector<std::string> added = newDirectories();
+			for (size_t i = 0; i < added.size(); i++)
+			{
+				watchDirectory(added[i], directories, handles);
+			}
+
+			DWORD signaled = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, 100);
+			if (signaled >= WAIT_OBJECT_0 + handles.size())
+			{
+				continue;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));		// Let the editor finish writing
+			FindNextChangeNotification(handles[signaled - WAIT_OBJECT_0]);
+
+			std::vector<std::string> changed;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < watched.size(); i++)
+				{
+					for (size_t j = 0; j < watched[i].dependencies.size(); j++)
+					{
+						long long time = modificationTime(watched[i].dependencies[j]);
+						if (time != watched[i].times[j])
+						{
+							changed.push_back(watched[i].dependencies[j]);
+							watched[i].times[j] = time;
+						}
+					}
+				}
+			}
+			if (!changed.empty())
+			{
+				reloadChanged(changed);
+			}
+		}
+
+		for (size_t i = 0; i < handles.size(); i++)
+		{
+			FindCloseChangeNotification(handles[i]);
+		}
+	}
+
+	static void watchDirectory(const std::string& path, std::vector<std::string>& directories, std::vector<HANDLE>& handles)
+	{
+		std::string full = FileSystem::canonical(path);
+		if (std::find(directories.begin(), directories.end(), full) != directories.end() || handles.size() == MAXIMUM_WAIT_OBJECTS)
+		{
+			return;
+		}
+		HANDLE handle = FindFirstChangeNotificationA(full.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			printf("ERROR::SHADER_WATCHER::CANT_WATCH %s\n", path.c_str());
+			return;
+		}
+		directories.push_back(full);
+		handles.push_back(handle);
+	}
+#else
+	void run()
+	{
+		std::map<int, std::string> directories;		// Watch descriptor to canonical directory
+		int fd = inotify_init1(IN_NONBLOCK);
+		if (fd < 0 || !watchDirectory(fd, directory, directories))
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			return;
+		}
+
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		while (running)
+		{
+			std::vector<std::string> added = newDirectories();
+			for (size_t i = 0; i < added.size(); i++)
+			{
+				watchDirectory(fd, added[i], directories);		// Watching a directory again returns its descriptor
+			}
+
+			struct pollfd descriptor = { fd, POLLIN, 0 };
+			if (::poll(&descriptor, 1, 100) <= 0)
+			{
+				continue;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));		// Let the editor finish writing
+
+			// Drain every pending event, editors often produce several per save
+			std::vector<std::string> changed;
+			ssize_t length;
+			while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char* it = buffer; it < buffer + length; )
+				{
+					const struct inotify_event* event = (const struct inotify_event*)it;
+					std::map<int, std::string>::const_iterator parent = directories.find(event->wd);
+					if (event->len > 0 && parent != directories.end())
+					{
+						changed.push_back(FileSystem::canonical(parent->second + "/" + event->name));
+					}
+					it += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			if (!changed.empty())
+			{
+				reloadChanged(changed);
+			}
+		}
+
+		close(fd);
+	}
+
+	static bool watchDirectory(int fd, const std::string& path, std::map<int, std::string>& directories)
+	{
+		int wd = inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0)
+		{
+			printf("ERROR::SHADER_WATCHER::CANT_WATCH %s\n", path.c_str());
+			return false;
+		}
+		directories[wd] = FileSystem::canonical(path);
+		return true;
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/* x86 SIMD support. SSE2 is always there on x64 builds; SSSE3 and AVX2 code is compiled per function with SIMD_TARGET_SSSE3
+   or SIMD_TARGET_AVX2 and only called after Simd::hasSSSE3() or Simd::hasAVX2() said the CPU supports it,
+   so the executable still runs anywhere. */
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSSE3
+#define SIMD_TARGET_AVX2
+#endif
+
+namespace Simd
+{
+	inline bool detectSSSE3()
+	{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#elif defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3") != 0;
+#else
+		return false;
+#endif
+	}
+
+	inline bool detectAVX2()
+	{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)		// The OS must save the YMM registers
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}
+
+	/* Detected once */
+	inline bool hasSSSE3()
+	{
+		static const bool supported = detectSSSE3();
+		return supported;
+	}
+
+	inline bool hasAVX2()
+	{
+		static const bool supported = detectAVX2();
+		return supported;
+	}
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef STD140_H
+#define STD140_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tuple>
+#include <type_traits>
+
+/* C++ mirrors of GLSL types for structs uploaded to std140 uniform blocks.
+   vec3 keeps a size of 12 so a scalar can follow it like in GLSL, which means the member itself
+   needs alignas(16) : the STD140_MEMBER check below catches a missing one at compile time. */
+namespace std140
+{
+	struct alignas(8) vec2 { float x, y; };
+	struct vec3 { float x, y, z; };
+	struct alignas(16) vec4 { float x, y, z, w; };
+	struct alignas(8) ivec2 { int32_t x, y; };
+	struct alignas(16) ivec4 { int32_t x, y, z, w; };
+	struct alignas(16) mat4 { vec4 columns[4]; };
+	struct boolean { uint32_t value; };		// GLSL bool is 4 bytes in a block, a type of its own so it maps to GL_BOOL and not uint
+}
+
+/* Base alignment, size and GL type of a member following the std140 rules */
+template <typename T>
+struct Std140Traits;
+
+#define STD140_TRAITS(Type, Align, Size, GLType) \
+	template <> struct Std140Traits<Type> { static constexpr size_t align = Align; static constexpr size_t size = Size; static constexpr GLenum glType = GLType; };
+
+STD140_TRAITS(float, 4, 4, GL_FLOAT)
+STD140_TRAITS(int32_t, 4, 4, GL_INT)
+STD140_TRAITS(uint32_t, 4, 4, GL_UNSIGNED_INT)
+STD140_TRAITS(std140::boolean, 4, 4, GL_BOOL)
+STD140_TRAITS(std140::vec2, 8, 8, GL_FLOAT_VEC2)
+STD140_TRAITS(std140::vec3, 16, 12, GL_FLOAT_VEC3)
+STD140_TRAITS(std140::vec4, 16, 16, GL_FLOAT_VEC4)
+STD140_TRAITS(std140::ivec2, 8, 8, GL_INT_VEC2)
+STD140_TRAITS(std140::ivec4, 16, 16, GL_INT_VEC4)
+STD140_TRAITS(std140::mat4, 16, 64, GL_FLOAT_MAT4)
+
+#undef STD140_TRAITS
+
+constexpr size_t std140AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/* Arrays : the element alignment and stride are rounded up to a vec4, the stride may be larger than the alignment (mat4) */
+template <typename T, size_t N>
+struct Std140Traits<T[N]>
+{
+	static constexpr size_t stride = std140AlignUp(Std140Traits<T>::size, 16);
+	static constexpr size_t align = std140AlignUp(Std140Traits<T>::align, 16);
+	static constexpr size_t size = stride * N;
+	static constexpr GLenum glType = Std140Traits<T>::glType;
+};
+
+/* Offsets of a block whose members have the types Ts, in declaration order, all computed at compile time */
+template <typename... Ts>
+struct Std140Layout
+{
+	static constexpr size_t count = sizeof...(Ts);
+
+	template <size_t index>
+	using Type = typename std::tuple_element<index, std::tuple<Ts...>>::type;
+
+	static constexpr size_t offset(size_t index)
+	{
+		const size_t aligns[] = { Std140Traits<Ts>::align... };
+		const size_t sizes[] = { Std140Traits<Ts>::size... };
+
+		size_t position = 0;
+		for (size_t i = 0; i < index; i++)
+		{
+			position = std140AlignUp(position, aligns[i]) + sizes[i];
+		}
+		return std140AlignUp(position, aligns[index]);
+	}
+
+	static constexpr size_t memberSize(size_t index)
+	{
+		const size_t sizes[] = { Std140Traits<Ts>::size... };
+		return sizes[index];
+	}
+
+	static constexpr GLenum glType(size_t index)
+	{
+		const GLenum types[] = { Std140Traits<Ts>::glType... };
+		return types[index];
+	}
+
+	/* Size of the whole block, rounded up to a vec4 like a std140 structure */
+	static constexpr size_t size()
+	{
+		const size_t sizes[] = { Std140Traits<Ts>::size... };
+		return std140AlignUp(offset(count - 1) + sizes[count - 1], 16);
+	}
+};
+
+/* Compile-time check that a member of a struct with a Layout typedef has the type of its layout entry and sits at its std140 offset.
+   The size check catches arrays of scalars, whose C++ stride is tighter than the vec4 of std140. */
+#define STD140_MEMBER(Struct, index, member) \
+	static_assert(std::is_same<decltype(Struct::member), Struct::Layout::Type<index>>::value, #Struct "::" #member " does not have its layout type"); \
+	static_assert(sizeof(Struct::member) == Struct::Layout::memberSize(index), #Struct "::" #member " does not have its std140 size"); \
+	static_assert(offsetof(Struct, member) == Struct::Layout::offset(index), #Struct "::" #member " is not at its std140 offset")
+
+#define STD140_STRUCT(Struct) \
+	static_assert(sizeof(Struct) <= Struct::Layout::size(), #Struct " is larger than its std140 block")
+
+#endif
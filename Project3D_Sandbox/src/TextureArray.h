@@ -0,0 +1,110 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "MipGenerator.h"
+#include "TextureLoader.h"
+#include "UploadScheduler.h"
+
+#include <stdio.h>
+
+/* Same size images as the layers of one GL_TEXTURE_2D_ARRAY. Objects pick their image with a layer index,
+   per instance or per vertex, so a single bind and a single draw can cover objects with different textures.
+   Unlike an atlas, layers never bleed into each other and keep their own wrap mode and full mip chain. */
+class TextureArray
+{
+public:
+	/* Allocates every level of every layer in RGBA8. Layers are black until filled with add(). */
+	TextureArray(int width, int height, int layers, const TextureOptions& options = TextureOptions())
+		: width(width), height(height), layers(layers), used(0), pending(0), mipmaps(options.mipmaps)
+	{
+		int levels = mipmaps ? MipGenerator::levelCount(width, height) : 1;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, options.minFilter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, options.magFilter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		for (int level = 0, w = width, h = height; level < levels; level++)
+		{
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+
+	/* With layers still uploading, cancel them on the scheduler first */
+	~TextureArray()
+	{
+		glDeleteTextures(1, &texture);
+	}
+
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	/* Queue an image of 1 to 4 channels into the next free layer, returns the layer or -1 if the array is full
+	   or the size doesn't match. pixels must stay valid until the layer is uploaded. Mipmaps are generated
+	   once every queued layer is in. */
+	int add(const unsigned char* pixels, int imageWidth, int imageHeight, int channels, UploadScheduler& uploads, float priority = 0.0f)
+	{
+		if (imageWidth != width || imageHeight != height)
+		{
+			printf("ERROR::TEXTURE_ARRAY::SIZE_MISMATCH %dx%d in a %dx%d array\n", imageWidth, imageHeight, width, height);
+			return -1;
+		}
+		if (used == layers)
+		{
+			printf("ERROR::TEXTURE_ARRAY::FULL %d layers\n", layers);
+			return -1;
+		}
+
+		static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		int layer = used++;
+		pending++;
+		uploads.textureLayer(texture, 0, layer, width, height, formats[channels - 1], GL_UNSIGNED_BYTE, channels, pixels, priority,
+			[this]()
+			{
+				if (--pending == 0 && mipmaps)
+				{
+					glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+					glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+				}
+			});
+		return layer;
+	}
+
+	unsigned int getTexture() const
+	{
+		return texture;
+	}
+
+	/* Layers filled so far, out of capacity() */
+	int size() const
+	{
+		return used;
+	}
+
+	int capacity() const
+	{
+		return layers;
+	}
+
+	/* Layers queued but not uploaded yet */
+	int uploading() const
+	{
+		return pending;
+	}
+
+private:
+	unsigned int texture;
+	int width;
+	int height;
+	int layers;
+	int used;
+	int pending;
+	bool mipmaps;
+};
+
+#endif
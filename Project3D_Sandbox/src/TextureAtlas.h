@@ -0,0 +1,376 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+#include "UploadScheduler.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/* Skyline bottom-left rectangle packing : the top edge of what is placed so far is kept as a list of horizontal
+   segments, each rectangle goes where its top ends lowest, the narrowest segment winning ties. */
+class SkylinePacker
+{
+public:
+	SkylinePacker(int width, int height)
+		: width(width), height(height), usedArea(0)
+	{
+		Segment first = { 0, 0, width };
+		skyline.push_back(first);
+	}
+
+	/* Place a width x height rectangle, returns false if it doesn't fit anywhere */
+	bool insert(int rectWidth, int rectHeight, int& x, int& y)
+	{
+		int bestTop = height + 1, bestWidth = width + 1;
+		size_t best = skyline.size();
+		for (size_t i = 0; i < skyline.size(); i++)
+		{
+			int top = fit(i, rectWidth, rectHeight);
+			if (top >= 0 && (top + rectHeight < bestTop || (top + rectHeight == bestTop && skyline[i].width < bestWidth)))
+			{
+				best = i;
+				bestTop = top + rectHeight;
+				bestWidth = skyline[i].width;
+			}
+		}
+		if (best == skyline.size())
+		{
+			return false;
+		}
+
+		x = skyline[best].x;
+		y = bestTop - rectHeight;
+		Segment placed = { x, bestTop, rectWidth };
+		skyline.insert(skyline.begin() + best, placed);
+
+		// The segments now under the rectangle shrink or disappear
+		for (size_t i = best + 1; i < skyline.size(); i++)
+		{
+			int overlap = placed.x + placed.width - skyline[i].x;
+			if (overlap <= 0)
+			{
+				break;
+			}
+			skyline[i].x += overlap;
+			skyline[i].width -= overlap;
+			if (skyline[i].width > 0)
+			{
+				break;
+			}
+			skyline.erase(skyline.begin() + i);
+			i--;
+		}
+
+		// Neighbours at the same height merge back into one segment
+		for (size_t i = 0; i + 1 < skyline.size(); i++)
+		{
+			if (skyline[i].y == skyline[i + 1].y)
+			{
+				skyline[i].width += skyline[i + 1].width;
+				skyline.erase(skyline.begin() + i + 1);
+				i--;
+			}
+		}
+
+		usedArea += (long long)rectWidth * rectHeight;
+		return true;
+	}
+
+	/* Fraction of the area covered by rectangles */
+	float occupancy() const
+	{
+		return (float)((double)usedArea / ((double)width * height));
+	}
+
+private:
+	struct Segment
+	{
+		int x;
+		int y;			// Top of what is below this segment
+		int width;
+	};
+
+	int width;
+	int height;
+	long long usedArea;
+	std::vector<Segment> skyline;		// Left to right, covering the whole width
+
+	/* Lowest y a rectangle can sit at with its left edge on segment index, -1 if it goes past the page */
+	int fit(size_t index, int rectWidth, int rectHeight) const
+	{
+		if (skyline[index].x + rectWidth > width)
+		{
+			return -1;
+		}
+		int y = 0;
+		int remaining = rectWidth;
+		for (size_t i = index; remaining > 0; i++)
+		{
+			y = std::max(y, skyline[i].y);
+			if (y + rectHeight > height)
+			{
+				return -1;
+			}
+			remaining -= skyline[i].width;
+		}
+		return y;
+	}
+};
+
+/* Where an image ended up : its page and the texture coordinates of its corners, gutter excluded */
+struct AtlasRect
+{
+	unsigned int page;
+	int x;			// Texels of the image inside the page
+	int y;
+	int width;
+	int height;
+	float u0;
+	float v0;
+	float u1;
+	float v1;
+
+	/* Texture coordinates of the image, [0, 1] on both axes, to coordinates inside the page */
+	void map(float u, float v, float& pageU, float& pageV) const
+	{
+		pageU = u0 + u * (u1 - u0);
+		pageV = v0 + v * (v1 - v0);
+	}
+};
+
+/* Packs many small images into a few RGBA pages so sprites using them share a texture bind, and can share
+   a draw call once their texture coordinates are remapped. Every image is surrounded by a gutter repeating its
+   edge texels : filtering and the smaller mip levels sample the image itself rather than its neighbours.
+   Mipmaps stop at the level where the gutter is one texel wide. */
+class TextureAtlas
+{
+public:
+	/* gutter is rounded up to a power of two, so it halves cleanly with each level */
+	explicit TextureAtlas(int pageSize = 2048, int gutter = 4)
+		: pageSize(pageSize), gutter(1), occupancy(0.0f)
+	{
+		while (this->gutter < gutter)
+		{
+			this->gutter *= 2;
+		}
+	}
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	~TextureAtlas()
+	{
+		if (!textures.empty())
+		{
+			glDeleteTextures((GLsizei)textures.size(), textures.data());
+		}
+	}
+
+	/* Copy an image of 1 to 4 channels, read like GL does : missing green and blue are 0, missing alpha 255.
+	   Returns its index for rect(), valid once build() succeeded. */
+	int add(const unsigned char* pixels, int width, int height, int channels)
+	{
+		Image image;
+		image.width = width;
+		image.height = height;
+		image.rgba.resize((size_t)width * height * 4);
+		for (size_t i = 0; i < (size_t)width * height; i++)
+		{
+			const unsigned char* texel = pixels + i * channels;
+			unsigned char* out = &image.rgba[i * 4];
+			out[0] = texel[0];
+			out[1] = channels > 1 ? texel[1] : 0;
+			out[2] = channels > 2 ? texel[2] : 0;
+			out[3] = channels > 3 ? texel[3] : 255;
+		}
+		images.push_back(image);
+		return (int)images.size() - 1;
+	}
+
+	/* Pack every image added so far into pages, tallest first. Prints an error and returns false if an image
+	   is larger than a page. The copies of the images are released. */
+	bool build()
+	{
+		std::vector<size_t> order(images.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+		{
+			if (images[a].height != images[b].height)
+			{
+				return images[a].height > images[b].height;
+			}
+			return images[a].width > images[b].width;
+		});
+
+		rects.assign(images.size(), AtlasRect());
+		pages.clear();
+		std::vector<SkylinePacker> packers;
+		for (size_t n = 0; n < order.size(); n++)
+		{
+			const Image& image = images[order[n]];
+			int paddedWidth = image.width + 2 * gutter;
+			int paddedHeight = image.height + 2 * gutter;
+			if (paddedWidth > pageSize || paddedHeight > pageSize)
+			{
+				printf("ERROR::TEXTURE_ATLAS::IMAGE_TOO_LARGE %dx%d in %dx%d pages\n", image.width, image.height, pageSize, pageSize);
+				return false;
+			}
+
+			// First page with room, a new one otherwise
+			int x = 0, y = 0;
+			size_t page = 0;
+			while (page < packers.size() && !packers[page].insert(paddedWidth, paddedHeight, x, y))
+			{
+				page++;
+			}
+			if (page == packers.size())
+			{
+				packers.push_back(SkylinePacker(pageSize, pageSize));
+				pages.push_back(std::vector<unsigned char>((size_t)pageSize * pageSize * 4, 0));
+				packers.back().insert(paddedWidth, paddedHeight, x, y);
+			}
+
+			AtlasRect& rect = rects[order[n]];
+			rect.page = (unsigned int)page;
+			rect.x = x + gutter;
+			rect.y = y + gutter;
+			rect.width = image.width;
+			rect.height = image.height;
+			rect.u0 = (float)rect.x / pageSize;
+			rect.v0 = (float)rect.y / pageSize;
+			rect.u1 = (float)(rect.x + rect.width) / pageSize;
+			rect.v1 = (float)(rect.y + rect.height) / pageSize;
+			blit(image, rect, pages[page]);
+		}
+
+		occupancy = 0.0f;
+		for (size_t i = 0; i < packers.size(); i++)
+		{
+			occupancy += packers[i].occupancy() / packers.size();
+		}
+		images.clear();
+		return true;
+	}
+
+	/* Create one texture per page and queue its pixels on the scheduler. Pages stay owned by the atlas,
+	   which must outlive the uploads. GL_TEXTURE_MAX_LEVEL is clamped so mipmaps never mix images. */
+	void upload(UploadScheduler& uploads, const TextureOptions& options = TextureOptions())
+	{
+		int maxLevel = 0;
+		for (int g = gutter; g > 1; g /= 2)
+		{
+			maxLevel++;
+		}
+
+		for (size_t page = 0; page < pages.size(); page++)
+		{
+			// Pages are bound on their own, so they keep their filters in the texture
+			unsigned int texture = TextureLoader::createPlaceholder();
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.minFilter);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, options.magFilter);
+			textures.push_back(texture);
+			bool mipmaps = options.mipmaps;
+			uploads.texture(texture, 0, GL_RGBA8, pageSize, pageSize, GL_RGBA, GL_UNSIGNED_BYTE, 4, pages[page].data(), options.priority,
+				[texture, mipmaps, maxLevel]()
+				{
+					if (mipmaps)
+					{
+						glBindTexture(GL_TEXTURE_2D, texture);
+						glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+						glGenerateMipmap(GL_TEXTURE_2D);
+					}
+				});
+		}
+	}
+
+	const AtlasRect& rect(int image) const
+	{
+		return rects[image];
+	}
+
+	size_t pageCount() const
+	{
+		return pages.size();
+	}
+
+	/* Texture of a page, 0 before upload() */
+	unsigned int texture(unsigned int page) const
+	{
+		return page < textures.size() ? textures[page] : 0;
+	}
+
+	const unsigned char* pagePixels(unsigned int page) const
+	{
+		return pages[page].data();
+	}
+
+	/* Average fraction of a page covered by images and their gutters */
+	float getOccupancy() const
+	{
+		return occupancy;
+	}
+
+	/* Remap the texture coordinates of count interleaved vertices to an image of the atlas.
+	   stride and offset are in floats, e.g. 8 and 6 for position, color, texture coordinates. */
+	static void remap(float* vertices, size_t count, size_t stride, size_t offset, const AtlasRect& rect)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			float* uv = vertices + i * stride + offset;
+			rect.map(uv[0], uv[1], uv[0], uv[1]);
+		}
+	}
+
+private:
+	struct Image
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> rgba;
+	};
+
+	int pageSize;
+	int gutter;
+	float occupancy;
+	std::vector<Image> images;					// Added but not built yet
+	std::vector<AtlasRect> rects;
+	std::vector<std::vector<unsigned char>> pages;
+	std::vector<unsigned int> textures;
+
+	/* Copy the image into its rectangle, then repeat its border rows and columns over the gutter */
+	void blit(const Image& image, const AtlasRect& rect, std::vector<unsigned char>& page) const
+	{
+		size_t pageRow = (size_t)pageSize * 4;
+		for (int y = 0; y < image.height; y++)
+		{
+			unsigned char* row = &page[(size_t)(rect.y + y) * pageRow + (size_t)rect.x * 4];
+			memcpy(row, &image.rgba[(size_t)y * image.width * 4], (size_t)image.width * 4);
+			for (int g = 1; g <= gutter; g++)
+			{
+				memcpy(row - g * 4, row, 4);
+				memcpy(row + (image.width - 1 + g) * 4, row + (image.width - 1) * 4, 4);
+			}
+		}
+
+		// Whole padded rows, so the corners get the corner texels
+		size_t paddedBytes = (size_t)(image.width + 2 * gutter) * 4;
+		unsigned char* first = &page[(size_t)rect.y * pageRow + (size_t)(rect.x - gutter) * 4];
+		unsigned char* last = first + (size_t)(image.height - 1) * pageRow;
+		for (int g = 1; g <= gutter; g++)
+		{
+			memcpy(first - g * pageRow, first, paddedBytes);
+			memcpy(last + g * pageRow, last, paddedBytes);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,450 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "FileSystem.h"
+#include "TextureLoader.h"
+#include "TexturePack.h"
+#include "TextureStreamer.h"
+#include "UploadScheduler.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextureCache;
+
+/* Shared reference to a cached texture. Copies add a reference; the texture is deleted with the last one. */
+class TextureHandle
+{
+public:
+	TextureHandle()
+		: cache(nullptr), entry(nullptr)
+	{
+	}
+
+	TextureHandle(const TextureHandle& other)
+		: cache(other.cache), entry(other.entry)
+	{
+		retain();
+	}
+
+	TextureHandle& operator=(const TextureHandle& other)
+	{
+		if (entry != other.entry)
+		{
+			reset();
+			cache = other.cache;
+			entry = other.entry;
+			retain();
+		}
+		return *this;
+	}
+
+	~TextureHandle()
+	{
+		reset();
+	}
+
+	/* Drop this reference now, e.g. before the GL context goes away */
+	inline void reset();
+
+	/* GL name to bind, 0 for an empty handle. Counts as a use for the budget, so call it when binding. */
+	inline unsigned int get() const;
+
+	explicit operator bool() const
+	{
+		return entry != nullptr;
+	}
+
+private:
+	friend class TextureCache;
+	struct Entry;
+
+	TextureCache* cache;
+	Entry* entry;
+
+	TextureHandle(TextureCache* cache, Entry* entry)
+		: cache(cache), entry(entry)
+	{
+		retain();
+	}
+
+	inline void retain();
+};
+
+struct TextureHandle::Entry
+{
+	std::string key;
+	unsigned int texture;
+	unsigned int references;
+	unsigned long long lastUse;		// Frame of the last get()
+	bool measured;					// Fully loaded and its size known
+	bool streamed;					// Levels managed by the TextureStreamer, measured every frame
+	size_t bytes;					// Levels still resident
+	GLint internalFormat;
+	bool compressed;
+	int width;						// Of level 0
+	int height;
+	int baseLevel;					// Levels below were dropped for the budget
+	int levels;
+	size_t levelBytes[16];
+};
+
+/* One texture per file and set of load parameters : a scene reusing an image decodes and uploads it once.
+   Files are looked up in the texture pack first, then decoded by the loader. Handles must be released before the cache.
+   With a memory budget, textures without handles stay resident for reuse until the budget needs their room :
+   update() evicts them least recently used first, then drops the top mip level of the least recently bound textures. */
+class TextureCache
+{
+public:
+	unsigned int hits;			// load() calls served by a texture already there
+	unsigned int misses;		// load() calls that created a texture
+	unsigned int freed;			// Textures deleted, by their last handle or by the budget
+	unsigned int evicted;		// Of those, deleted by the budget
+	unsigned int droppedLevels;	// Top mip levels dropped by the budget
+	size_t used;				// Bytes of the fully loaded textures, estimated from their levels
+	size_t highWater;			// Highest value of used so far
+
+	/* pack can be nullptr or closed, every file is decoded then */
+	TextureCache(TextureLoader& loader, UploadScheduler& uploads, const TexturePack* pack = nullptr)
+		: hits(0), misses(0), freed(0), evicted(0), droppedLevels(0), used(0), highWater(0),
+		loader(loader), uploads(uploads), pack(pack), streamer(nullptr), budgetBytes(0), maxSize(0), frame(0), overBudget(false)
+	{
+	}
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	~TextureCache()
+	{
+		purge();
+		if (!entries.empty())
+		{
+			printf("ERROR::TEXTURE_CACHE::HANDLES_OUTLIVE_CACHE %u textures\n", (unsigned int)entries.size());
+		}
+	}
+
+	/* bytes = 0 means no limit, textures are then deleted with their last handle. Images loaded from now on
+	   are also capped to maxSize texels on both axes, halved on the decoding worker or read from a smaller pack level. */
+	void setBudget(size_t bytes, int maxSize = 0)
+	{
+		budgetBytes = bytes;
+		this->maxSize = maxSize;
+	}
+
+	/* Large packed images loaded from now on go through streamer, which must outlive the cache */
+	void setStreamer(TextureStreamer* streamer)
+	{
+		this->streamer = streamer;
+	}
+
+	/* Call on the GL thread. The texture shows its placeholder until streamed in, like TextureLoader::load(). */
+	TextureHandle load(const std::string& path, const TextureOptions& requested = TextureOptions())
+	{
+		TextureOptions options = requested;
+		if (maxSize > 0 && (options.maxSize == 0 || options.maxSize > maxSize))
+		{
+			options.maxSize = maxSize;
+		}
+
+		std::string key = makeKey(path, options);
+		std::unordered_map<std::string, TextureHandle::Entry>::iterator found = entries.find(key);
+		if (found != entries.end())
+		{
+			hits++;
+			return TextureHandle(this, &found->second);
+		}
+
+		misses++;
+		unsigned int texture = 0;
+		bool streamed = false;
+		if (pack && pack->isOpen())
+		{
+			std::string::size_type slash = path.find_last_of("/\\");
+			std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+			texture = streamer ? streamer->load(name, options) : 0;
+			streamed = texture != 0;
+			if (!texture)
+			{
+				texture = pack->load(name, options, uploads);
+			}
+		}
+		if (!texture)
+		{
+			texture = loader.load(path, options);
+		}
+
+		TextureHandle::Entry& entry = entries[key];
+		entry = TextureHandle::Entry();
+		entry.key = key;
+		entry.texture = texture;
+		entry.lastUse = frame;
+		entry.streamed = streamed;
+		return TextureHandle(this, &entry);
+	}
+
+	/* Call once per frame on the GL thread, after UploadScheduler::update() : measures the textures that finished
+	   loading, then frees memory until used fits the budget. Prints an error once if what is left can't shrink further. */
+	void update()
+	{
+		for (std::unordered_map<std::string, TextureHandle::Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+		{
+			TextureHandle::Entry& entry = it->second;
+			if (entry.streamed)
+			{
+				size_t bytes = streamer->residentBytes(entry.texture);
+				used = used - entry.bytes + bytes;
+				entry.bytes = bytes;
+				entry.measured = true;
+			}
+			else if (!entry.measured && !loader.isLoading(entry.texture) && !uploads.isQueued(entry.texture))
+			{
+				measure(entry);
+				used += entry.bytes;
+			}
+		}
+		highWater = std::max(highWater, used);
+
+		while (budgetBytes > 0 && used > budgetBytes)
+		{
+			// Linear scans : a sandbox scene holds tens of textures, not thousands
+			TextureHandle::Entry* unused = nullptr;
+			TextureHandle::Entry* shrinkable = nullptr;
+			for (std::unordered_map<std::string, TextureHandle::Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				TextureHandle::Entry& entry = it->second;
+				if (!entry.measured)
+				{
+					continue;
+				}
+				if (entry.references == 0 && (!unused || entry.lastUse < unused->lastUse))
+				{
+					unused = &entry;
+				}
+				else if (entry.references > 0 && canDrop(entry) && (!shrinkable || entry.lastUse < shrinkable->lastUse ||
+					(entry.lastUse == shrinkable->lastUse && entry.bytes > shrinkable->bytes)))
+				{
+					shrinkable = &entry;
+				}
+			}
+
+			if (unused)
+			{
+				evicted++;
+				destroy(unused);
+			}
+			else if (shrinkable)
+			{
+				dropTopLevel(*shrinkable);
+			}
+			else
+			{
+				if (!overBudget)
+				{
+					printf("ERROR::TEXTURE_CACHE::OVER_BUDGET %.2f MB used for %.2f MB\n", used / (1024.0 * 1024.0), budgetBytes / (1024.0 * 1024.0));
+				}
+				overBudget = true;
+				break;
+			}
+		}
+		if (used <= budgetBytes)
+		{
+			overBudget = false;
+		}
+		frame++;
+	}
+
+	/* Delete the textures kept without handles now, e.g. before the GL context goes away */
+	void purge()
+	{
+		std::vector<TextureHandle::Entry*> unused;
+		for (std::unordered_map<std::string, TextureHandle::Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+		{
+			if (it->second.references == 0)
+			{
+				unused.push_back(&it->second);
+			}
+		}
+		for (size_t i = 0; i < unused.size(); i++)
+		{
+			destroy(unused[i]);
+		}
+	}
+
+	/* Textures alive, with handles or kept for the budget */
+	size_t size() const
+	{
+		return entries.size();
+	}
+
+private:
+	friend class TextureHandle;
+
+	/* Never drops a level if the next one is smaller than this on its longer side */
+	static const int MIN_RESIDENT_SIZE = 64;
+
+	TextureLoader& loader;
+	UploadScheduler& uploads;
+	const TexturePack* pack;
+	TextureStreamer* streamer;
+	size_t budgetBytes;
+	int maxSize;
+	unsigned long long frame;
+	bool overBudget;				// OVER_BUDGET already printed
+	std::unordered_map<std::string, TextureHandle::Entry> entries;		// Nodes don't move, handles point into them
+
+	/* Everything that changes the texture object; priority only changes when it is uploaded, and wrap and filters
+	   live in samplers, so materials sampling the same image differently share one texture. flip, premultiplyAlpha and mipOptions hold
+	   whether the texture comes from the pack or the loader : the pack hands the options it can't honour to the loader. */
+	static std::string makeKey(const std::string& path, const TextureOptions& options)
+	{
+		char parameters[128];
+		snprintf(parameters, sizeof(parameters), "|%d%d%d%d%d|%d%d%d|%d|%d",
+			options.mipmaps ? 1 : 0, options.cpuMipmaps ? 1 : 0, options.flip ? 1 : 0, options.premultiplyAlpha ? 1 : 0, options.rgb565 ? 1 : 0,
+			(int)options.mipOptions.filter, options.mipOptions.srgb ? 1 : 0, options.mipOptions.alphaWeighted ? 1 : 0,
+			(int)options.compression, options.maxSize);
+		return FileSystem::canonical(path) + parameters;
+	}
+
+	/* Last handle gone : without a budget the texture goes at once, with one it stays until update() needs the room */
+	void release(TextureHandle::Entry* entry)
+	{
+		if (--entry->references > 0 || budgetBytes > 0)
+		{
+			return;
+		}
+		destroy(entry);
+	}
+
+	/* Stop whatever is still streaming into the texture, then delete it */
+	void destroy(TextureHandle::Entry* entry)
+	{
+		loader.cancel(entry->texture);
+		uploads.cancel(entry->texture);
+		if (entry->streamed)
+		{
+			streamer->cancel(entry->texture);
+		}
+		glDeleteTextures(1, &entry->texture);
+		used -= entry->bytes;
+		freed++;
+		std::string key = entry->key;		// Erasing by the node's own key would read it while it is destroyed
+		entries.erase(key);
+	}
+
+	/* Bytes per texel drivers allocate, RGB being padded to RGBA */
+	static size_t texelBytes(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8:
+			return 1;
+		case GL_RG8:
+		case GL_RGB565:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	/* Size of every level the texture has, read back from GL so glGenerateMipmap chains count too */
+	void measure(TextureHandle::Entry& entry)
+	{
+		glBindTexture(GL_TEXTURE_2D, entry.texture);
+		GLint compressed = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &entry.internalFormat);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &entry.width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &entry.height);
+		GLint maxLevel = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		entry.compressed = compressed != 0;
+
+		entry.levels = 0;
+		entry.bytes = 0;
+		while (entry.levels < 16 && entry.levels <= maxLevel)
+		{
+			GLint width = 0, height = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, entry.levels, GL_TEXTURE_WIDTH, &width);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, entry.levels, GL_TEXTURE_HEIGHT, &height);
+			if (width == 0 || height == 0)
+			{
+				break;
+			}
+			GLint size = 0;
+			if (entry.compressed)
+			{
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, entry.levels, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			}
+			entry.levelBytes[entry.levels] = entry.compressed ? (size_t)size : (size_t)width * height * texelBytes(entry.internalFormat);
+			entry.bytes += entry.levelBytes[entry.levels];
+			entry.levels++;
+		}
+		entry.measured = true;
+	}
+
+	/* Streamed textures are left to the streamer, which already drops the levels nobody samples */
+	bool canDrop(const TextureHandle::Entry& entry) const
+	{
+		if (entry.streamed)
+		{
+			return false;
+		}
+		int next = entry.baseLevel + 1;
+		return next < entry.levels && std::max(entry.width >> next, entry.height >> next) >= MIN_RESIDENT_SIZE;
+	}
+
+	/* The next level becomes the base, then the old one is respecified empty so the driver frees it */
+	void dropTopLevel(TextureHandle::Entry& entry)
+	{
+		int level = entry.baseLevel++;
+		glBindTexture(GL_TEXTURE_2D, entry.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.baseLevel);
+		if (entry.compressed)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, (GLenum)entry.internalFormat, 0, 0, 0, 0, NULL);
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		used -= entry.levelBytes[level];
+		entry.bytes -= entry.levelBytes[level];
+		droppedLevels++;
+	}
+};
+
+inline void TextureHandle::retain()
+{
+	if (entry)
+	{
+		entry->references++;
+	}
+}
+
+inline void TextureHandle::reset()
+{
+	if (entry)
+	{
+		cache->release(entry);
+	}
+	cache = nullptr;
+	entry = nullptr;
+}
+
+inline unsigned int TextureHandle::get() const
+{
+	if (!entry)
+	{
+		return 0;
+	}
+	entry->lastUse = cache->frame;
+	return entry->texture;
+}
+
+#endif
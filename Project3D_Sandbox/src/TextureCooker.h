@@ -0,0 +1,207 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include "BlockCompressor.h"
+#include "FileSystem.h"
+#include "MipGenerator.h"
+#include "TexturePack.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <stb_image.h>
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* Offline conversion of a directory of images into a texture pack, run with "--cook [sourceDirectory] [pack]".
+   Images are decoded once here, kept top row first like the loader decodes them, and given their whole mip chain, filtered with a Kaiser
+   window in linear space, alpha weighted when there is an alpha channel. */
+namespace TextureCooker
+{
+	/* Options the chains are built with, TextureOptions::mipOptions must match for mipmapped loads to be served by the pack */
+	inline MipOptions mipOptions()
+	{
+		MipOptions options;
+		options.filter = MIP_FILTER_KAISER;
+		options.srgb = true;
+		options.alphaWeighted = true;
+		return options;
+	}
+
+	inline bool isImage(const std::string& name)
+	{
+		static const char* extensions[] = { ".jpg", ".jpeg", ".png", ".tga", ".bmp" };
+		std::string::size_type dot = name.find_last_of('.');
+		if (dot == std::string::npos)
+		{
+			return false;
+		}
+		std::string extension = name.substr(dot);
+		for (size_t i = 0; i < extension.size(); i++)
+		{
+			extension[i] = (char)tolower((unsigned char)extension[i]);
+		}
+		for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+		{
+			if (extension == extensions[i])
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline uint64_t alignToPage(uint64_t offset)
+	{
+		return (offset + TexturePackFormat::PAGE_SIZE - 1) / TexturePackFormat::PAGE_SIZE * TexturePackFormat::PAGE_SIZE;
+	}
+
+	/* Cook every image of sourceDirectory into packPath. Returns false if nothing could be written.
+	   compress stores BC3 blocks for images with alpha, grey + alpha included, and BC1 for the others, which drivers without S3TC can't load. */
+	inline bool cook(const std::string& sourceDirectory, const std::string& packPath, bool compress = false)
+	{
+		using namespace TexturePackFormat;
+		Timer timer;
+
+		std::vector<Entry> entries;
+		std::vector<std::vector<unsigned char>> pixels;		// All levels of an entry, back to back
+
+		ThreadPool pool;
+		MipGenerator mips(&pool);
+		BlockCompressor compressor(&pool);
+		size_t texelBytes = 0;
+		double encodeMs = 0.0;
+
+		std::vector<std::string> files = FileSystem::listDirectory(sourceDirectory);
+		stbi_set_flip_vertically_on_load_thread(0);		// TextureOptions::flip is applied at load time, see TexturePack::load()
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (!isImage(files[i]))
+			{
+				continue;
+			}
+			if (files[i].size() >= MAX_NAME)
+			{
+				printf("ERROR::TEXTURE_COOKER::NAME_TOO_LONG %s\n", files[i].c_str());
+				continue;
+			}
+
+			int width, height, channels;
+			std::string path = sourceDirectory + "/" + files[i];
+			unsigned char* image = stbi_load(path.c_str(), &width, &height, &channels, 0);
+			if (!image)
+			{
+				printf("ERROR::TEXTURE_COOKER::DECODE_FAILED %s : %s\n", path.c_str(), stbi_failure_reason());
+				continue;
+			}
+
+			Entry entry;
+			memset(&entry, 0, sizeof(entry));
+			strcpy(entry.name, files[i].c_str());
+			entry.width = (uint32_t)width;
+			entry.height = (uint32_t)height;
+			entry.channels = (uint32_t)channels;
+
+			// Level offsets are relative to the entry for now, made absolute once the layout is known
+			MipOptions mipOptions = TextureCooker::mipOptions();
+			entry.mipFilter = (uint8_t)mipOptions.filter;
+			entry.mipSrgb = (uint8_t)(mipOptions.srgb && channels >= 3);
+			entry.mipAlphaWeighted = (uint8_t)(mipOptions.alphaWeighted && channels == 4);
+			std::vector<unsigned char> levels;
+			std::vector<MipLevel> chain;
+			mips.generate(image, width, height, channels, mipOptions, levels, chain, MAX_LEVELS);
+			stbi_image_free(image);
+			for (size_t level = 0; level < chain.size(); level++)
+			{
+				entry.level[level].offset = chain[level].offset;
+				entry.level[level].size = (uint32_t)chain[level].size;
+				entry.level[level].width = (uint32_t)chain[level].width;
+				entry.level[level].height = (uint32_t)chain[level].height;
+			}
+			entry.levels = (uint32_t)chain.size();
+			texelBytes += levels.size();
+
+			if (compress)
+			{
+				Timer encode;
+				BlockFormat format = BlockCompressor::opaqueOrAlpha(channels);
+				std::vector<unsigned char> blocks;
+				for (size_t level = 0; level < chain.size(); level++)
+				{
+					size_t size = BlockCompressor::compressedSize(format, chain[level].width, chain[level].height);
+					entry.level[level].offset = blocks.size();
+					entry.level[level].size = (uint32_t)size;
+					blocks.resize(blocks.size() + size);
+					compressor.compress(levels.data() + chain[level].offset, chain[level].width, chain[level].height, channels, format,
+						blocks.data() + entry.level[level].offset);
+				}
+				entry.format = 1 + format;
+				levels.swap(blocks);
+				encodeMs += encode.elapsedMs();
+			}
+
+			entries.push_back(entry);
+			pixels.push_back(std::move(levels));
+		}
+
+		// Layout : header and index first, then each texture on its own pages
+		uint64_t offset = alignToPage(sizeof(Header) + entries.size() * sizeof(Entry));
+		std::vector<uint64_t> starts(entries.size());
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			starts[i] = offset;
+			for (uint32_t level = 0; level < entries[i].levels; level++)
+			{
+				entries[i].level[level].offset += offset;
+			}
+			offset = alignToPage(offset + pixels[i].size());
+		}
+
+		FILE* pack = fopen(packPath.c_str(), "wb");
+		if (!pack)
+		{
+			printf("ERROR::TEXTURE_COOKER::CANNOT_WRITE %s\n", packPath.c_str());
+			return false;
+		}
+
+		Header header = { MAGIC, VERSION, (uint32_t)entries.size(), 0 };
+		bool written = fwrite(&header, sizeof(header), 1, pack) == 1;
+		if (!entries.empty())
+		{
+			written = written && fwrite(entries.data(), sizeof(Entry), entries.size(), pack) == entries.size();
+		}
+
+		static const char padding[PAGE_SIZE] = { 0 };
+		uint64_t position = sizeof(Header) + entries.size() * sizeof(Entry);
+		size_t bytes = 0;
+		for (size_t i = 0; i < entries.size() && written; i++)
+		{
+			written = fwrite(padding, 1, (size_t)(starts[i] - position), pack) == starts[i] - position;
+			written = written && fwrite(pixels[i].data(), 1, pixels[i].size(), pack) == pixels[i].size();
+			position = starts[i] + pixels[i].size();
+			bytes += pixels[i].size();
+		}
+		written = fclose(pack) == 0 && written;
+		if (!written)
+		{
+			printf("ERROR::TEXTURE_COOKER::WRITE_FAILED %s\n", packPath.c_str());
+			return false;
+		}
+
+		printf("Cooked %u textures into %s : %.2f MB of texels in %.2f ms\n",
+			(unsigned int)entries.size(), packPath.c_str(), texelBytes / (1024.0 * 1024.0), timer.elapsedMs());
+		if (compress)
+		{
+			printf("Compressed to %.2f MB (%.1fx smaller) in %.2f ms (%.1f MB/s)\n", bytes / (1024.0 * 1024.0),
+				bytes > 0 ? (double)texelBytes / bytes : 0.0, encodeMs, texelBytes / (1024.0 * 1024.0) / (encodeMs / 1000.0));
+		}
+		return true;
+	}
+}
+
+#endif
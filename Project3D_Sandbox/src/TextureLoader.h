@@ -0,0 +1,498 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "BlockCompressor.h"
+#include "FileSystem.h"
+#include "FormatNormalizer.h"
+#include "GLExtensions.h"
+#include "JpegDecoder.h"
+#include "MipGenerator.h"
+#include "MPMCQueue.h"
+#include "PngDecoder.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "UploadScheduler.h"
+
+#include <stb_image.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum TextureCompression
+{
+	TEXTURE_COMPRESSION_NONE,
+	TEXTURE_COMPRESSION_BC1_BC3,	// BC1 without alpha, BC3 with alpha, needs EXT_texture_compression_s3tc
+	TEXTURE_COMPRESSION_BC7			// Needs ARB_texture_compression_bptc, falls back to BC1 / BC3
+};
+
+/* How a texture is loaded. wrap and the filters aren't baked into 2D textures, bind SamplerState(options) with a SamplerCache. */
+struct TextureOptions
+{
+	GLint wrap;
+	GLint minFilter;
+	GLint magFilter;
+	bool mipmaps;		// glGenerateMipmap once the image is uploaded
+	bool cpuMipmaps;	// With mipmaps : build the chain on the decoding worker with mipOptions instead of glGenerateMipmap
+	MipOptions mipOptions;
+	TextureCompression compression;	// Block compress on the worker, uploaded uncompressed if the driver can't sample the format
+	bool flip;			// Row 0 becomes the bottom of the image like GL expects, in the conversion pass or the upload
+	bool premultiplyAlpha;	// RGBA color multiplied by alpha before mipmaps and compression, for premultiplied blending
+	bool rgb565;		// Opaque RGB stored in 16 bits when uncompressed and not mipmapped on the CPU, where the driver allows it
+	int maxSize;		// Larger images are halved on the worker until both sizes fit, 0 for no limit
+	float priority;		// Upload order once decoded, higher first, see UploadScheduler
+
+	TextureOptions()
+		: wrap(GL_REPEAT), minFilter(GL_LINEAR), magFilter(GL_LINEAR), mipmaps(true), cpuMipmaps(false), compression(TEXTURE_COMPRESSION_NONE), flip(false),
+		premultiplyAlpha(false), rgb565(false), maxSize(0), priority(0.0f)
+	{
+	}
+};
+
+/* Decodes images on a thread pool. load() returns a texture name at once, holding a 1x1 white placeholder;
+   decoded pixels come back through a lock-free queue and update() hands them to the upload scheduler,
+   which streams them to the GPU within its per-frame budget. */
+class TextureLoader
+{
+public:
+	unsigned int uploaded;		// Images uploaded so far
+	unsigned int failed;		// Images that couldn't be decoded, they keep the placeholder
+	double decodeMs;			// Decode time summed over all workers
+	unsigned int parallelJpegs;	// JPEGs decoded across their restart intervals, see JpegDecoder
+
+	/* threads = 0 uses one worker per core, minus the GL thread. The scheduler must outlive the loader. */
+	explicit TextureLoader(UploadScheduler& uploads, unsigned int threads = 0)
+		: uploaded(0), failed(0), decodeMs(0.0), parallelJpegs(0), uploads(uploads), inFlight(0), decodeUs(0), parallelDecodes(0), ready(256), pool(threads), mips(&pool), compressor(&pool)
+	{
+	}
+
+	/* Waits for the decodes still running, their pixels are dropped along with the uploads not done yet */
+	~TextureLoader()
+	{
+		pool.wait();
+		Decoded* image = nullptr;
+		while (ready.pop(image))
+		{
+			release(image);
+		}
+		for (size_t i = 0; i < streaming.size(); i++)
+		{
+			uploads.cancel(streaming[i]->texture);
+			release(streaming[i]);
+		}
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	/* New texture with a 1x1 white image, left bound to GL_TEXTURE_2D. Sampling state is left to the sampler bound with it.
+	   GL_TEXTURE_MAX_LEVEL is 0 so it stays complete with a mipmapped min filter. */
+	static unsigned int createPlaceholder()
+	{
+		static const unsigned char white[4] = { 255, 255, 255, 255 };
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+		return texture;
+	}
+
+	/* Driver support for a block format, valid once GLExtensions::load() ran */
+	static bool canSample(BlockFormat format)
+	{
+		const GLExtensions& ext = GLExtensions::get();
+		return format == BLOCK_FORMAT_BC7 ? ext.textureCompressionBPTC : ext.textureCompressionS3TC;
+	}
+
+	static GLenum compressedFormat(BlockFormat format)
+	{
+		static const GLenum formats[3] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RGBA_BPTC_UNORM };
+		return formats[format];
+	}
+
+	/* Call on the GL thread. The returned texture can be bound right away, it shows the placeholder until update() uploads it. */
+	unsigned int load(const std::string& path, const TextureOptions& options = TextureOptions())
+	{
+		unsigned int texture = createPlaceholder();
+
+		Decoded* image = new Decoded();
+		image->texture = texture;
+		image->path = path;
+		image->options = options;
+		image->pixels = nullptr;
+		image->error = nullptr;
+		image->cancelled = false;
+		image->blockFormat = -1;
+		image->encodeMs = 0.0;
+
+		// Resolved here since the workers can't ask the driver ; the channel count decides between BC1 and BC3 once decoded
+		image->allowBC1BC3 = options.compression != TEXTURE_COMPRESSION_NONE && canSample(BLOCK_FORMAT_BC1);
+		image->allowBC7 = options.compression == TEXTURE_COMPRESSION_BC7 && canSample(BLOCK_FORMAT_BC7);
+		image->allowRGB565 = options.rgb565 && GLExtensions::get().rgb565;
+		image->flipOnUpload = false;
+
+		inFlight++;
+		decoding.push_back(image);
+		pool.submit([this, image]() { decode(image); });
+		return texture;
+	}
+
+	/* Call once per frame on the GL thread, before UploadScheduler::update() : queues the images decoded
+	   since the last call. Returns how many. */
+	unsigned int update()
+	{
+		unsigned int count = 0;
+		Decoded* image = nullptr;
+		while (ready.pop(image))
+		{
+			queue(image);
+			count++;
+		}
+
+		if (count > 0)
+		{
+			decodeMs = decodeUs.load() / 1000.0;
+			parallelJpegs = parallelDecodes.load();
+		}
+		return count;
+	}
+
+	/* Block until every requested image is uploaded, e.g. before taking a screenshot. Ignores the scheduler budget. */
+	void finish()
+	{
+		while (inFlight > 0)
+		{
+			update();
+			if (uploads.update() == 0)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	/* Call on the GL thread before deleting a texture returned by load() : its decode result is dropped when it comes back
+	   and its pending uploads are removed, so they never reach a texture name GL may have reused meanwhile */
+	void cancel(unsigned int texture)
+	{
+		for (size_t i = 0; i < decoding.size(); i++)
+		{
+			if (decoding[i]->texture == texture)
+			{
+				decoding[i]->cancelled = true;		// Still owned by a worker or the queue, freed in queue()
+			}
+		}
+		for (size_t i = 0; i < streaming.size(); i++)
+		{
+			if (streaming[i]->texture == texture)
+			{
+				uploads.cancel(texture);
+				release(streaming[i]);
+				streaming.erase(streaming.begin() + i);
+				inFlight--;
+				return;
+			}
+		}
+	}
+
+	/* Images requested but not uploaded yet */
+	unsigned int pending() const
+	{
+		return inFlight.load();
+	}
+
+	/* Whether a texture returned by load() is still decoding or uploading */
+	bool isLoading(unsigned int texture) const
+	{
+		for (size_t i = 0; i < decoding.size(); i++)
+		{
+			if (decoding[i]->texture == texture && !decoding[i]->cancelled)
+			{
+				return true;
+			}
+		}
+		for (size_t i = 0; i < streaming.size(); i++)
+		{
+			if (streaming[i]->texture == texture)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	struct Decoded
+	{
+		unsigned int texture;
+		std::string path;
+		TextureOptions options;
+		unsigned char* pixels;		// nullptr if decoding failed
+		const char* error;			// stbi_failure_reason() is per thread, so it is read on the worker
+		bool cancelled;				// Set and read on the GL thread only
+		int width;
+		int height;
+		int channels;						// As decoded
+		UploadFormat format;				// Of the rows in pixels and chain once converted
+		bool flipOnUpload;					// Rows weren't converted, the scheduler flips them instead
+		std::vector<unsigned char> chain;	// Every level when built on the CPU, pixels is freed then
+		std::vector<MipLevel> levels;
+		bool allowBC1BC3;
+		bool allowBC7;
+		bool allowRGB565;
+		int blockFormat;					// BlockFormat of chain, -1 if it holds texels
+		size_t texelBytes;					// Size of the levels before compression
+		double encodeMs;
+	};
+
+	UploadScheduler& uploads;
+	std::vector<Decoded*> decoding;		// Submitted to the pool, not back through the queue yet
+	std::vector<Decoded*> streaming;	// Queued on the scheduler, freed once their last band is issued
+
+	std::atomic<unsigned int> inFlight;
+	std::atomic<unsigned long long> decodeUs;
+	std::atomic<unsigned int> parallelDecodes;
+	MPMCQueue<Decoded*> ready;		// Decoded on a worker, waiting for the GL thread
+	ThreadPool pool;				// Workers stop before the queue is destroyed
+	MipGenerator mips;
+	BlockCompressor compressor;
+
+	/* Worker thread */
+	void decode(Decoded* image)
+	{
+		Timer timer;
+
+		// Decoded from a mapping of the file : PNGs with SIMD unfiltering, JPEGs with restart markers on this pool as well.
+		// Never flipped by stb, that would be a pass of its own : see normalize()
+		stbi_set_flip_vertically_on_load_thread(0);
+		MappedFile file;
+		bool parallel = false;
+		if (!file.open(image->path))
+		{
+			image->pixels = nullptr;
+			image->error = "can't open file";
+		}
+		else
+		{
+			const unsigned char* bytes = (const unsigned char*)file.data();
+			if (PngDecoder::isPng(bytes, file.size()))
+			{
+				image->pixels = PngDecoder::load(bytes, file.size(), &image->width, &image->height, &image->channels);
+			}
+			else
+			{
+				image->pixels = JpegDecoder::load(bytes, file.size(), &image->width, &image->height, &image->channels, &pool, &parallel);
+			}
+			if (!image->pixels)
+			{
+				image->error = stbi_failure_reason();
+			}
+		}
+		file.close();
+		if (parallel)
+		{
+			parallelDecodes++;
+		}
+
+		if (image->pixels && image->options.maxSize > 0 && (image->width > image->options.maxSize || image->height > image->options.maxSize))
+		{
+			// Smaller copy in chain, mipmaps and blocks are then built from it as usual
+			std::vector<unsigned char> smaller;
+			int sourceWidth = image->width, sourceHeight = image->height;
+			mips.downscale(image->pixels, image->width, image->height, image->channels, image->options.mipOptions, image->options.maxSize, smaller);
+			stbi_image_free(image->pixels);
+			printf("Texture %s : %dx%d downscaled to %dx%d\n", image->path.c_str(), sourceWidth, sourceHeight, image->width, image->height);
+			image->chain.swap(smaller);
+			image->pixels = image->chain.data();
+		}
+
+		if (image->pixels)
+		{
+			normalize(image);
+		}
+
+		if (image->pixels && buildsLevels(image))
+		{
+			// Compressed textures can't use glGenerateMipmap, their chain is always built here
+			int maxLevels = image->options.mipmaps ? 16 : 1;
+			std::vector<unsigned char> chain;
+			mips.generate(image->pixels, image->width, image->height, image->format.bytesPerPixel, image->options.mipOptions, chain, image->levels, maxLevels);
+			if (image->chain.empty())
+			{
+				stbi_image_free(image->pixels);
+			}
+			image->chain.swap(chain);
+			image->pixels = image->chain.data();
+			if (image->allowBC1BC3 || image->allowBC7)
+			{
+				compress(image);
+			}
+		}
+
+		decodeUs += (unsigned long long)(timer.elapsedMs() * 1000.0);
+		while (!ready.push(image))
+		{
+			std::this_thread::yield();		// The GL thread is behind on uploads
+		}
+	}
+
+	static bool buildsLevels(const Decoded* image)
+	{
+		return image->allowBC1BC3 || image->allowBC7 || (image->options.mipmaps && image->options.cpuMipmaps);
+	}
+
+	/* Worker thread : rewrite the rows in their upload format, flipped and premultiplied on the way. Blocks are compressed
+	   from the decoded channels. If only the flip is left and the levels aren't built here, the upload flips instead. */
+	void normalize(Decoded* image)
+	{
+		bool blocks = image->allowBC1BC3 || image->allowBC7;
+		image->format = blocks ? FormatNormalizer::tight(image->channels)
+			: FormatNormalizer::choose(image->channels, image->allowRGB565 && !buildsLevels(image));
+		bool premultiply = image->options.premultiplyAlpha;
+		if (!FormatNormalizer::needsConversion(image->channels, image->format, premultiply) && !(image->options.flip && buildsLevels(image)))
+		{
+			image->flipOnUpload = image->options.flip;
+			return;
+		}
+
+		std::vector<unsigned char> converted((size_t)image->width * image->height * image->format.bytesPerPixel);
+		FormatNormalizer::convert(image->pixels, image->width, image->height, image->channels, image->format, premultiply,
+			image->options.flip, converted.data());
+		if (image->chain.empty())
+		{
+			stbi_image_free(image->pixels);
+		}
+		image->chain.swap(converted);
+		image->pixels = image->chain.data();
+	}
+
+	/* Worker thread : replace the levels of chain by their blocks */
+	void compress(Decoded* image)
+	{
+		Timer timer;
+		BlockFormat format = image->allowBC7 ? BLOCK_FORMAT_BC7 : BlockCompressor::opaqueOrAlpha(image->channels);
+		std::vector<unsigned char> blocks;
+		std::vector<MipLevel> levels = image->levels;
+		size_t offset = 0;
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			levels[level].offset = offset;
+			levels[level].size = BlockCompressor::compressedSize(format, levels[level].width, levels[level].height);
+			offset += levels[level].size;
+		}
+		blocks.resize(offset);
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			const MipLevel& source = image->levels[level];
+			compressor.compress(image->chain.data() + source.offset, source.width, source.height, image->format.bytesPerPixel, format,
+				blocks.data() + levels[level].offset);
+		}
+
+		image->texelBytes = image->chain.size();
+		image->chain.swap(blocks);
+		image->levels.swap(levels);
+		image->pixels = image->chain.data();
+		image->blockFormat = format;
+		image->encodeMs = timer.elapsedMs();
+	}
+
+	/* GL thread : hand the pixels to the scheduler, they are freed once the last band is issued */
+	void queue(Decoded* image)
+	{
+		decoding.erase(std::find(decoding.begin(), decoding.end(), image));
+		if (image->cancelled)
+		{
+			inFlight--;
+			release(image);
+			return;
+		}
+		if (!image->pixels)
+		{
+			printf("ERROR::TEXTURE_LOADER::DECODE_FAILED %s : %s\n", image->path.c_str(), image->error ? image->error : "unknown");
+			failed++;
+			inFlight--;
+			delete image;
+			return;
+		}
+
+		const UploadFormat& format = image->format;
+		streaming.push_back(image);
+		if (image->blockFormat < 0)
+		{
+			FormatNormalizer::swizzle(image->texture, format.internalFormat);
+		}
+		if (image->levels.empty())
+		{
+			uploads.texture(image->texture, 0, format.internalFormat, image->width, image->height, format.format, format.type,
+				format.bytesPerPixel, image->pixels, image->options.priority, [this, image]() { complete(image); }, image->flipOnUpload);
+			return;
+		}
+
+		// Same order as a texture pack : the placeholder stays complete until the last level is in
+		for (size_t level = 0; level < image->levels.size(); level++)
+		{
+			const MipLevel& info = image->levels[level];
+			UploadScheduler::Done done;
+			if (level == image->levels.size() - 1)
+			{
+				done = [this, image]() { complete(image); };
+			}
+			if (image->blockFormat >= 0)
+			{
+				BlockFormat blocks = (BlockFormat)image->blockFormat;
+				uploads.compressedTexture(image->texture, (GLint)level, compressedFormat(blocks), info.width, info.height,
+					BlockCompressor::blockBytes(blocks), image->chain.data() + info.offset, image->options.priority, done);
+				continue;
+			}
+			uploads.texture(image->texture, (GLint)level, format.internalFormat, info.width, info.height, format.format, format.type,
+				format.bytesPerPixel, image->chain.data() + info.offset, image->options.priority, done);
+		}
+	}
+
+	static void release(Decoded* image)
+	{
+		if (image->chain.empty())
+		{
+			stbi_image_free(image->pixels);
+		}
+		delete image;
+	}
+
+	/* GL thread, called by the scheduler after the last band */
+	void complete(Decoded* image)
+	{
+		if (!image->levels.empty())
+		{
+			glBindTexture(GL_TEXTURE_2D, image->texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image->levels.size() - 1);
+		}
+		else if (image->options.mipmaps)
+		{
+			glBindTexture(GL_TEXTURE_2D, image->texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);		// Back to the GL default
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+
+		if (image->blockFormat >= 0)
+		{
+			double megabytes = image->texelBytes / (1024.0 * 1024.0);
+			printf("Texture %s : %s %dx%d, %u levels, %.2f MB -> %.2f MB (%.1fx smaller), encoded in %.2f ms (%.1f MB/s)\n",
+				image->path.c_str(), BlockCompressor::name((BlockFormat)image->blockFormat), image->width, image->height,
+				(unsigned int)image->levels.size(), megabytes, image->chain.size() / (1024.0 * 1024.0),
+				(double)image->texelBytes / image->chain.size(), image->encodeMs, megabytes / (image->encodeMs / 1000.0));
+		}
+
+		streaming.erase(std::find(streaming.begin(), streaming.end(), image));
+		release(image);
+		inFlight--;
+		uploaded++;
+	}
+};
+
+#endif
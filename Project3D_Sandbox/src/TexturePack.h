@@ -0,0 +1,277 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <glad/glad.h>
+
+#include "BlockCompressor.h"
+#include "FileSystem.h"
+#include "TextureLoader.h"
+#include "UploadScheduler.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* File layout of a texture pack, written by TextureCooker :
+   header, entry index, then the levels of each texture, every texture starting on a new page.
+   Pixels are tightly packed rows, top row first as decoded, with the whole mip chain precomputed : TextureOptions::flip
+   is applied when they are staged, like for decoded images. A compressed entry stores 4x4 blocks in row order instead,
+   see BlockCompressor; those can't be flipped at upload. The mip options the chain was filtered with are stored so loads
+   asking for others go to the loader. */
+namespace TexturePackFormat
+{
+	const uint32_t MAGIC = 0x4B415054;		// "TPAK"
+	const uint32_t VERSION = 5;			// 3 : rows no longer stored bottom up, 4 : grey + alpha compressed as BC3, 5 : mip options
+	const uint32_t PAGE_SIZE = 4096;
+	const uint32_t MAX_LEVELS = 16;			// Enough for 32768 x 32768
+	const uint32_t MAX_NAME = 64;
+
+	/* Entry::format : raw texels, or 1 + the BlockFormat of the blocks */
+	const uint32_t FORMAT_RAW = 0;
+	const uint32_t FORMAT_BC1 = 1 + BLOCK_FORMAT_BC1;
+	const uint32_t FORMAT_BC3 = 1 + BLOCK_FORMAT_BC3;
+	const uint32_t FORMAT_BC7 = 1 + BLOCK_FORMAT_BC7;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;			// Entries following the header
+		uint32_t reserved;
+	};
+
+	struct Level
+	{
+		uint64_t offset;		// From the start of the file
+		uint32_t size;
+		uint32_t width;
+		uint32_t height;
+		uint32_t reserved;
+	};
+
+	struct Entry
+	{
+		char name[MAX_NAME];	// File name of the source image, e.g. "container.jpg"
+		uint32_t width;
+		uint32_t height;
+		uint32_t channels;		// 1 to 4, one byte each
+		uint32_t levels;
+		uint32_t format;		// FORMAT_RAW or a block format
+		uint8_t mipFilter;		// MipOptions of the chain, as they apply to these channels
+		uint8_t mipSrgb;
+		uint8_t mipAlphaWeighted;
+		uint8_t reserved;
+		Level level[MAX_LEVELS];
+	};
+
+	static_assert(sizeof(Header) == 16, "Texture pack header layout changed");
+	static_assert(sizeof(Level) == 24, "Texture pack level layout changed");
+	static_assert(sizeof(Entry) == MAX_NAME + 24 + MAX_LEVELS * sizeof(Level), "Texture pack entry layout changed");
+}
+
+/* Cooked textures read straight from a memory mapping : no decoding, no mipmap generation, and only the pages
+   of the textures actually loaded are ever read from disk. The pack must stay open while its uploads are pending. */
+class TexturePack
+{
+public:
+	typedef TexturePackFormat::Entry Entry;
+
+	TexturePack()
+		: header(nullptr), entries(nullptr)
+	{
+	}
+
+	TexturePack(const TexturePack&) = delete;
+	TexturePack& operator=(const TexturePack&) = delete;
+
+	/* Map the pack and check its index, prints an error and returns false if it is missing or corrupt */
+	bool open(const std::string& path)
+	{
+		close();
+		if (!file.open(path))
+		{
+			return false;
+		}
+
+		using namespace TexturePackFormat;
+		const Header* candidate = (const Header*)file.data();
+		if (file.size() < sizeof(Header) || candidate->magic != MAGIC || candidate->version != VERSION
+			|| file.size() < sizeof(Header) + (uint64_t)candidate->count * sizeof(Entry))
+		{
+			printf("ERROR::TEXTURE_PACK::INVALID_HEADER %s\n", path.c_str());
+			close();
+			return false;
+		}
+
+		const Entry* index = (const Entry*)(file.data() + sizeof(Header));
+		for (uint32_t i = 0; i < candidate->count; i++)
+		{
+			if (index[i].levels == 0 || index[i].levels > MAX_LEVELS || index[i].channels == 0 || index[i].channels > 4 || index[i].format > FORMAT_BC7)
+			{
+				printf("ERROR::TEXTURE_PACK::INVALID_ENTRY %s %u\n", path.c_str(), i);
+				close();
+				return false;
+			}
+			for (uint32_t level = 0; level < index[i].levels; level++)
+			{
+				const Level& info = index[i].level[level];
+				uint64_t expected = index[i].format == FORMAT_RAW ? (uint64_t)info.width * info.height * index[i].channels
+					: BlockCompressor::compressedSize((BlockFormat)(index[i].format - 1), info.width, info.height);
+				if (info.offset + info.size > file.size() || expected != info.size)
+				{
+					printf("ERROR::TEXTURE_PACK::INVALID_LEVEL %s %u %u\n", path.c_str(), i, level);
+					close();
+					return false;
+				}
+			}
+		}
+
+		header = candidate;
+		entries = index;
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		header = nullptr;
+		entries = nullptr;
+	}
+
+	bool isOpen() const
+	{
+		return header != nullptr;
+	}
+
+	size_t size() const
+	{
+		return header ? header->count : 0;
+	}
+
+	const Entry& entry(size_t i) const
+	{
+		return entries[i];
+	}
+
+	/* Entry cooked from the file called name, nullptr if the pack has none */
+	const Entry* find(const std::string& name) const
+	{
+		for (size_t i = 0; i < size(); i++)
+		{
+			if (strncmp(entries[i].name, name.c_str(), TexturePackFormat::MAX_NAME) == 0)
+			{
+				return &entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	/* Pixels of a level inside the mapping, nothing is read from disk until they are touched */
+	const unsigned char* levelData(const Entry& texture, unsigned int level) const
+	{
+		return (const unsigned char*)file.data() + texture.level[level].offset;
+	}
+
+	/* Create a texture showing a placeholder and queue its levels, copied from the mapping into the staging ring,
+	   flipped on the way with options.flip. Returns 0 if the pack has no such texture, if it is compressed in a format
+	   the driver can't sample, or if it is compressed and options.flip is set : the image is then decoded instead. */
+	unsigned int load(const std::string& name, const TextureOptions& options, UploadScheduler& uploads) const
+	{
+		const Entry* cooked = find(name);
+		if (!cooked || !canServe(*cooked, options))
+		{
+			return 0;
+		}
+
+		if (cooked->format != TexturePackFormat::FORMAT_RAW && !TextureLoader::canSample((BlockFormat)(cooked->format - 1)))
+		{
+			printf("ERROR::TEXTURE_PACK::UNSUPPORTED_COMPRESSION %s : %s\n", name.c_str(), BlockCompressor::name((BlockFormat)(cooked->format - 1)));
+			return 0;
+		}
+
+		unsigned int first = firstLevel(*cooked, options.maxSize);
+
+		// The placeholder stays complete while level 0 streams in, the other levels are enabled once all are there
+		unsigned int texture = TextureLoader::createPlaceholder();
+		if (cooked->format == TexturePackFormat::FORMAT_RAW)
+		{
+			FormatNormalizer::swizzle(texture, FormatNormalizer::tight(cooked->channels).internalFormat);
+		}
+		unsigned int levels = options.mipmaps ? cooked->levels - first : 1;
+		for (unsigned int level = 0; level < levels; level++)
+		{
+			UploadScheduler::Done done;
+			if (level == levels - 1 && levels > 1)
+			{
+				done = [texture, levels]()
+				{
+					glBindTexture(GL_TEXTURE_2D, texture);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+				};
+			}
+			queueLevel(*cooked, first + level, texture, (GLint)level, uploads, options.priority, options.flip, done);
+		}
+		return texture;
+	}
+
+	/* Whether the cooked levels match what the loader would build with options, 0 is returned for the others so the
+	   caller falls back to the loader. Raw rows are flipped while staged, blocks would need every block rewritten.
+	   RGBA is cooked with straight alpha. Mip options only matter once a level other than the first is used. */
+	static bool canServe(const Entry& cooked, const TextureOptions& options)
+	{
+		if (options.flip && cooked.format != TexturePackFormat::FORMAT_RAW)
+		{
+			return false;
+		}
+		if (options.premultiplyAlpha && cooked.channels == 4)
+		{
+			return false;
+		}
+		return (!options.mipmaps && firstLevel(cooked, options.maxSize) == 0) || sameMips(cooked, options.mipOptions);
+	}
+
+	/* mipOptions reduced to what applies to the channels of cooked, like MipGenerator does */
+	static bool sameMips(const Entry& cooked, const MipOptions& mipOptions)
+	{
+		return cooked.mipFilter == (uint8_t)mipOptions.filter
+			&& cooked.mipSrgb == (uint8_t)(mipOptions.srgb && cooked.channels >= 3)
+			&& cooked.mipAlphaWeighted == (uint8_t)(mipOptions.alphaWeighted && cooked.channels == 4);
+	}
+
+	/* Levels larger than maxSize are skipped, the first one that fits becomes level 0 of the texture */
+	static unsigned int firstLevel(const Entry& cooked, int maxSize)
+	{
+		unsigned int first = 0;
+		while (maxSize > 0 && first + 1 < cooked.levels &&
+			((int)cooked.level[first].width > maxSize || (int)cooked.level[first].height > maxSize))
+		{
+			first++;
+		}
+		return first;
+	}
+
+	/* Queue one cooked level into a level of texture, allocated right before its first band. flip only applies to raw entries. */
+	void queueLevel(const Entry& cooked, unsigned int sourceLevel, GLuint texture, GLint level, UploadScheduler& uploads,
+		float priority, bool flip, UploadScheduler::Done done = UploadScheduler::Done()) const
+	{
+		const TexturePackFormat::Level& info = cooked.level[sourceLevel];
+		if (cooked.format != TexturePackFormat::FORMAT_RAW)
+		{
+			BlockFormat blocks = (BlockFormat)(cooked.format - 1);
+			uploads.compressedTexture(texture, level, TextureLoader::compressedFormat(blocks), (GLsizei)info.width, (GLsizei)info.height,
+				BlockCompressor::blockBytes(blocks), levelData(cooked, sourceLevel), priority, done);
+			return;
+		}
+		UploadFormat format = FormatNormalizer::tight(cooked.channels);
+		uploads.texture(texture, level, format.internalFormat, (GLsizei)info.width, (GLsizei)info.height,
+			format.format, GL_UNSIGNED_BYTE, cooked.channels, levelData(cooked, sourceLevel), priority, done, flip);
+	}
+
+private:
+	MappedFile file;
+	const TexturePackFormat::Header* header;
+	const TexturePackFormat::Entry* entries;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+#include "TexturePack.h"
+#include "UploadScheduler.h"
+
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+/* Mip residency for large cooked textures, a light form of virtual texturing. load() uploads only the levels up to
+   residentSize texels on their longer side and points GL_TEXTURE_BASE_LEVEL at the largest of them. Each frame, request()
+   gives the on-screen size of what samples the texture; update() then streams the next finer level in, one at a time,
+   while the projected texel density asks for it, and drops the finer levels no longer needed after dropFrames.
+   A level coming in starts at a min LOD of 1 that fades to 0 over fadeFrames, so sharpening doesn't pop. A bound sampler
+   overrides the min LOD of the texture, so the fade is read with minLod() and goes in the SamplerState. */
+class TextureStreamer
+{
+public:
+	unsigned int streamedLevels;	// Levels streamed in after load()
+	unsigned int droppedLevels;		// Levels dropped once no longer needed
+
+	/* pack and uploads must outlive the streamer */
+	TextureStreamer(const TexturePack& pack, UploadScheduler& uploads, int residentSize = 128, int fadeFrames = 8, int dropFrames = 300)
+		: streamedLevels(0), droppedLevels(0), pack(pack), uploads(uploads), residentSize(residentSize),
+		fadeFrames(fadeFrames > 0 ? fadeFrames : 1), dropFrames(dropFrames)
+	{
+	}
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	/* Call on the GL thread. Returns 0 if the pack has no such texture, can't sample its format or flip it as asked,
+	   or if the texture is small enough to be loaded whole with TexturePack::load(). The texture is owned by the caller,
+	   who must call cancel() before deleting it. */
+	unsigned int load(const std::string& name, const TextureOptions& options)
+	{
+		const TexturePack::Entry* cooked = pack.find(name);
+		if (!cooked || !options.mipmaps || !TexturePack::canServe(*cooked, options))
+		{
+			return 0;
+		}
+		if (cooked->format != TexturePackFormat::FORMAT_RAW && !TextureLoader::canSample((BlockFormat)(cooked->format - 1)))
+		{
+			return 0;
+		}
+
+		Streamed streamed;
+		streamed.cooked = cooked;
+		streamed.first = TexturePack::firstLevel(*cooked, options.maxSize);
+		streamed.levels = (int)(cooked->levels - streamed.first);
+		streamed.resident = 0;
+		while (streamed.resident + 1 < streamed.levels && longerSide(streamed, streamed.resident) > residentSize)
+		{
+			streamed.resident++;
+		}
+		if (streamed.resident == 0)
+		{
+			return 0;
+		}
+
+		// The placeholder stays at level 0 and is sampled until the resident levels are all in
+		streamed.texture = TextureLoader::createPlaceholder();
+		if (cooked->format == TexturePackFormat::FORMAT_RAW)
+		{
+			FormatNormalizer::swizzle(streamed.texture, FormatNormalizer::tight(cooked->channels).internalFormat);
+		}
+		streamed.priority = options.priority;
+		streamed.flip = options.flip;
+		streamed.base = streamed.resident;
+		streamed.ready = false;
+		streamed.loading = false;
+		streamed.wanted = (float)streamed.levels;
+		streamed.minLod = 0.0f;
+		streamed.unneeded = 0;
+		streamed.bytes = 0;
+		for (int level = streamed.resident; level < streamed.levels; level++)
+		{
+			UploadScheduler::Done done;
+			if (level == streamed.levels - 1)
+			{
+				unsigned int texture = streamed.texture;
+				done = [this, texture]()
+				{
+					Streamed* loaded = find(texture);
+					loaded->ready = true;
+					glBindTexture(GL_TEXTURE_2D, texture);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, loaded->base);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, loaded->levels - 1);
+				};
+			}
+			pack.queueLevel(*cooked, streamed.first + level, streamed.texture, (GLint)level, uploads, options.priority, options.flip, done);
+			streamed.bytes += levelBytes(streamed, level);
+		}
+		textures.push_back(streamed);
+		return streamed.texture;
+	}
+
+	/* Forget a texture before deleting it, its queued levels are cancelled. Does nothing for textures not from load(). */
+	void cancel(unsigned int texture)
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].texture == texture)
+			{
+				uploads.cancel(texture);
+				textures.erase(textures.begin() + i);
+				return;
+			}
+		}
+	}
+
+	/* The texture covers about width x height pixels on screen this frame, e.g. the projected bounds of the object using it.
+	   Several requests in a frame keep the finest. Textures not requested in a frame count as off screen. */
+	void request(unsigned int texture, float width, float height)
+	{
+		Streamed* streamed = find(texture);
+		if (!streamed || width <= 0.0f || height <= 0.0f)
+		{
+			return;
+		}
+
+		// Level whose texels map to about one pixel, the same log2 of the footprint the sampler computes
+		const TexturePackFormat::Level& top = streamed->cooked->level[streamed->first];
+		float density = std::max(top.width / width, top.height / height);
+		float level = density > 1.0f ? std::log2(density) : 0.0f;
+		streamed->wanted = std::min(streamed->wanted, level);
+	}
+
+	/* Call once per frame on the GL thread, after UploadScheduler::update() : fades the levels that came in,
+	   queues the next one for textures sampled finer than they are resident, and drops the unneeded ones */
+	void update()
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			Streamed& streamed = textures[i];
+			int needed = std::min((int)std::floor(streamed.wanted), streamed.levels - 1);
+			streamed.wanted = (float)streamed.levels;
+			if (!streamed.ready)
+			{
+				continue;
+			}
+
+			streamed.minLod = std::max(0.0f, streamed.minLod - 1.0f / fadeFrames);
+
+			if (needed < streamed.base)
+			{
+				streamed.unneeded = 0;
+				if (!streamed.loading)
+				{
+					streamIn(streamed, needed);
+				}
+			}
+			else if (needed > streamed.base && streamed.base < streamed.resident && !streamed.loading)
+			{
+				if (++streamed.unneeded >= dropFrames)
+				{
+					dropTopLevel(streamed);
+					streamed.unneeded = 0;
+				}
+			}
+			else
+			{
+				streamed.unneeded = 0;
+			}
+		}
+	}
+
+	/* GL_TEXTURE_MIN_LOD to sample the texture with this frame, in steps of 1 / fadeFrames so few samplers are created.
+	   0 for textures not from load(). */
+	float minLod(unsigned int texture) const
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].texture == texture)
+			{
+				return std::round(textures[i].minLod * fadeFrames) / fadeFrames;		// No float drift into new samplers
+			}
+		}
+		return 0.0f;
+	}
+
+	/* Bytes of the levels uploaded or being uploaded, 0 for textures not from load() */
+	size_t residentBytes(unsigned int texture) const
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].texture == texture)
+			{
+				return textures[i].bytes;
+			}
+		}
+		return 0;
+	}
+
+	/* Textures being streamed */
+	size_t size() const
+	{
+		return textures.size();
+	}
+
+private:
+	struct Streamed
+	{
+		unsigned int texture;
+		const TexturePack::Entry* cooked;
+		float priority;
+		bool flip;			// TextureOptions::flip, for the levels streamed in later
+		int first;			// Cooked level uploaded as level 0, see TextureOptions::maxSize
+		int levels;
+		int resident;		// Finest level uploaded by load(), never dropped
+		int base;			// GL_TEXTURE_BASE_LEVEL, the finest level resident
+		bool ready;			// Levels from load() all in
+		bool loading;		// base - 1 is streaming in
+		float wanted;		// Finest level requested this frame, levels if none
+		float minLod;		// See minLod(), above 0 while fading in a level
+		int unneeded;		// Frames base was finer than requested
+		size_t bytes;
+	};
+
+	const TexturePack& pack;
+	UploadScheduler& uploads;
+	int residentSize;
+	int fadeFrames;
+	int dropFrames;
+	std::vector<Streamed> textures;		// Linear lookups : a scene streams tens of textures
+
+	Streamed* find(unsigned int texture)
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].texture == texture)
+			{
+				return &textures[i];
+			}
+		}
+		return nullptr;
+	}
+
+	static int longerSide(const Streamed& streamed, int level)
+	{
+		const TexturePackFormat::Level& info = streamed.cooked->level[streamed.first + level];
+		return (int)std::max(info.width, info.height);
+	}
+
+	/* Estimated like the driver stores them, RGB being padded to RGBA */
+	static size_t levelBytes(const Streamed& streamed, int level)
+	{
+		const TexturePackFormat::Level& info = streamed.cooked->level[streamed.first + level];
+		if (streamed.cooked->format != TexturePackFormat::FORMAT_RAW)
+		{
+			return info.size;
+		}
+		return (size_t)info.width * info.height * (streamed.cooked->channels == 3 ? 4 : streamed.cooked->channels);
+	}
+
+	/* Queue base - 1, sooner the further the texture is from the level it needs. It becomes the base once fully in. */
+	void streamIn(Streamed& streamed, int needed)
+	{
+		int level = streamed.base - 1;
+		unsigned int texture = streamed.texture;
+		streamed.loading = true;
+		streamed.bytes += levelBytes(streamed, level);
+		pack.queueLevel(*streamed.cooked, streamed.first + level, texture, (GLint)level, uploads,
+			streamed.priority + (float)(streamed.base - needed), streamed.flip,
+			[this, texture, level]()
+			{
+				Streamed* loaded = find(texture);
+				loaded->loading = false;
+				loaded->base = level;
+				loaded->minLod = std::min(loaded->minLod + 1.0f, (float)(loaded->levels - 1 - level));
+				glBindTexture(GL_TEXTURE_2D, texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+				streamedLevels++;
+			});
+	}
+
+	/* The next level becomes the base, then the old one is respecified empty so the driver frees it */
+	void dropTopLevel(Streamed& streamed)
+	{
+		int level = streamed.base++;
+		glBindTexture(GL_TEXTURE_2D, streamed.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, streamed.base);
+		streamed.minLod = std::max(0.0f, streamed.minLod - 1.0f);
+		if (streamed.cooked->format != TexturePackFormat::FORMAT_RAW)
+		{
+			GLenum format = TextureLoader::compressedFormat((BlockFormat)(streamed.cooked->format - 1));
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, 0, 0, 0, 0, NULL);
+		}
+		else
+		{
+			UploadFormat format = FormatNormalizer::tight(streamed.cooked->channels);
+			glTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, 0, 0, 0, format.format, GL_UNSIGNED_BYTE, NULL);
+		}
+		streamed.bytes -= levelBytes(streamed, level);
+		droppedLevels++;
+	}
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads running submitted tasks in order. Workers sleep while there is nothing to do. */
+class ThreadPool
+{
+public:
+	/* count = 0 uses one worker per core, minus the one running the GL thread */
+	explicit ThreadPool(unsigned int count = 0)
+		: active(0), running(true)
+	{
+		if (count == 0)
+		{
+			unsigned int cores = std::thread::hardware_concurrency();
+			count = cores > 1 ? cores - 1 : 1;
+		}
+		for (unsigned int i = 0; i < count; i++)
+		{
+			workers.push_back(std::thread(&ThreadPool::run, this));
+		}
+	}
+
+	/* Runs the tasks still queued, then joins the workers */
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i].join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	void submit(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+
+	/* Run body(begin, end) over [0, count) in chunks of grain items, on the workers and the calling thread.
+	   Returns once every chunk is done. Safe to call from a worker : the caller keeps taking chunks itself,
+	   and helpers that only start afterwards find nothing left to do. */
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		grain = std::max(grain, (size_t)1);
+
+		struct Shared
+		{
+			std::function<void(size_t, size_t)> body;
+			size_t count;
+			size_t grain;
+			size_t chunks;
+			std::atomic<size_t> next;
+			std::atomic<size_t> done;
+			std::mutex mutex;
+			std::condition_variable finished;
+
+			void work()
+			{
+				for (;;)
+				{
+					size_t chunk = next++;
+					if (chunk >= chunks)
+					{
+						return;
+					}
+					body(chunk * grain, std::min(count, (chunk + 1) * grain));
+					if (++done == chunks)
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						finished.notify_all();
+					}
+				}
+			}
+		};
+
+		std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+		shared->body = body;
+		shared->count = count;
+		shared->grain = grain;
+		shared->chunks = (count + grain - 1) / grain;
+		shared->next = 0;
+		shared->done = 0;
+
+		size_t helpers = std::min(shared->chunks - 1, workers.size());
+		for (size_t i = 0; i < helpers; i++)
+		{
+			submit([shared]() { shared->work(); });
+		}
+		shared->work();
+
+		std::unique_lock<std::mutex> lock(shared->mutex);
+		shared->finished.wait(lock, [&shared] { return shared->done == shared->chunks; });
+	}
+
+	/* Block until every submitted task has finished */
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this] { return tasks.empty() && active == 0; });
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	unsigned int active;		// Tasks being run right now
+	bool running;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+
+	void run()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return !tasks.empty() || !running; });
+				if (tasks.empty())
+				{
+					return;
+				}
+				task = std::move(tasks.front());
+				tasks.pop_front();
+				active++;
+			}
+
+			task();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				active--;
+				if (tasks.empty() && active == 0)
+				{
+					idle.notify_all();
+				}
+			}
+		}
+	}
+};
+
+#endif
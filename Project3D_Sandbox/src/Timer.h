@@ -0,0 +1,29 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+
+/* Wall clock timer used to measure startup and per-frame costs */
+class Timer
+{
+public:
+	Timer()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		start = std::chrono::high_resolution_clock::now();
+	}
+
+	double elapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::high_resolution_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef UNIFORM_H
+#define UNIFORM_H
+
+#include <glad/glad.h>
+
+#include "Hash.h"
+
+#include <map>
+#include <string>
+
+/* Uniform name hashed at compile time, declare it constexpr to keep the hash out of the frame loop :
+   constexpr UniformName opacityName("opacity"); */
+struct UniformName
+{
+	const char* str;
+	uint32_t hash;
+
+	/* Also binds char buffers, so only hash up to the first NUL like the const char* overload does */
+	template <size_t N>
+	constexpr UniformName(const char (&literal)[N]) : str(literal), hash(fnv1a32(literal, boundedLength(literal, N - 1)))
+	{
+	}
+
+	explicit constexpr UniformName(const char* name) : str(name), hash(fnv1a32(name))
+	{
+	}
+};
+
+/* CPU copy of a uniform value */
+union UniformValue
+{
+	int i;
+	float f;
+};
+
+/* Maps a C++ type to its storage in the uniform shadow and to the GLSL types it may be bound to.
+   Types without a specialization can't be used as uniform handles. */
+template <typename T>
+struct UniformTraits;
+
+template <>
+struct UniformTraits<float>
+{
+	static bool accepts(GLenum type) { return type == GL_FLOAT; }
+	static void store(UniformValue& stored, float value) { stored.f = value; }
+};
+
+template <>
+struct UniformTraits<int>
+{
+	static bool accepts(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_INT:
+		case GL_SAMPLER_1D:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_3D:
+		case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_2D_SHADOW:
+		case GL_SAMPLER_1D_ARRAY:
+		case GL_SAMPLER_2D_ARRAY:
+		case GL_SAMPLER_BUFFER:
+		case GL_INT_SAMPLER_2D:
+		case GL_UNSIGNED_INT_SAMPLER_2D:
+			return true;
+		default:
+			return false;
+		}
+	}
+	static void store(UniformValue& stored, int value) { stored.i = value; }
+};
+
+template <>
+struct UniformTraits<bool>
+{
+	static bool accepts(GLenum type) { return type == GL_BOOL; }
+	static void store(UniformValue& stored, bool value) { stored.i = (int)value; }
+};
+
+/* Binding point of every uniform block name. All programs bind a block of the same name to the same point,
+   so a buffer bound there once serves every program sharing the block. */
+class UniformBlockBindings
+{
+public:
+	static GLuint get(const std::string& name)
+	{
+		std::map<std::string, GLuint>& bindings = table();
+		std::map<std::string, GLuint>::const_iterator it = bindings.find(name);
+		if (it != bindings.end())
+		{
+			return it->second;
+		}
+
+		GLuint binding = (GLuint)bindings.size();
+		bindings[name] = binding;
+		return binding;
+	}
+
+private:
+	static std::map<std::string, GLuint>& table()
+	{
+		static std::map<std::string, GLuint> bindings;
+		return bindings;
+	}
+};
+
+/* Typed handle to a uniform slot of a Shader, resolved once with Shader::uniform<T>() */
+template <typename T>
+class Uniform
+{
+public:
+	int slot;
+
+	Uniform() : slot(-1)
+	{
+	}
+
+	explicit Uniform(int slot) : slot(slot)
+	{
+	}
+
+	bool isValid() const
+	{
+		return slot >= 0;
+	}
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "Std140.h"
+#include "Uniform.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* Uniform buffer holding one std140 block described by T, which must provide a Layout typedef (see Std140.h).
+   Every update() writes the whole block with a single glBufferSubData into the next slot of a small ring,
+   so the driver doesn't have to wait for draws still reading the previous slot, then binds that slot
+   to the block's shared binding point, where every program using the block sees it. */
+template <typename T>
+class UniformBuffer
+{
+public:
+	unsigned int ID;		// Buffer object
+	GLuint binding;
+
+	explicit UniformBuffer(const char* blockName, unsigned int ringSize = 3)
+		: binding(UniformBlockBindings::get(blockName)), name(blockName), ringSize(ringSize > 0 ? ringSize : 1), slot(0)
+	{
+		STD140_STRUCT(T);
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = std140AlignUp(T::Layout::size(), (size_t)alignment);
+
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, stride * this->ringSize, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	/* Upload data and make it visible to every program using the block */
+	void update(const T& data)
+	{
+		slot = (slot + 1) % ringSize;
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, slot * stride, sizeof(T), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, slot * stride, T::Layout::size());
+	}
+
+	/* Compare the block as compiled in shader with the C++ layout : size, then offset and type of each member
+	   in declaration order. The compile-time checks can't see the GLSL, this catches the two drifting apart. */
+	bool validate(const Shader& shader) const
+	{
+		const Shader::UniformBlockInfo* block = shader.findUniformBlock(name);
+		if (!block)
+		{
+			return true;		// The program doesn't use the block
+		}
+
+		bool valid = (size_t)block->size == T::Layout::size();
+		if (!valid)
+		{
+			printf("ERROR::UNIFORM_BUFFER::%s::SIZE %d bytes in GLSL, %u in C++\n", name.c_str(), block->size, (unsigned int)T::Layout::size());
+		}
+
+		GLint count = 0;
+		glGetActiveUniformBlockiv(shader.ID, block->index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+		std::vector<GLint> indices(count > 0 ? count : 1);
+		glGetActiveUniformBlockiv(shader.ID, block->index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+
+		std::vector<GLint> offsets(indices.size()), types(indices.size());
+		glGetActiveUniformsiv(shader.ID, count, (const GLuint*)indices.data(), GL_UNIFORM_OFFSET, offsets.data());
+		glGetActiveUniformsiv(shader.ID, count, (const GLuint*)indices.data(), GL_UNIFORM_TYPE, types.data());
+
+		// Members in GLSL declaration order
+		std::vector<std::pair<GLint, GLint> > members;
+		for (GLint i = 0; i < count; i++)
+		{
+			members.push_back(std::make_pair(offsets[i], types[i]));
+		}
+		std::sort(members.begin(), members.end());
+
+		if (members.size() != T::Layout::count)
+		{
+			printf("ERROR::UNIFORM_BUFFER::%s::MEMBERS %u in GLSL, %u in C++\n", name.c_str(), (unsigned int)members.size(), (unsigned int)T::Layout::count);
+			return false;
+		}
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			if ((size_t)members[i].first != T::Layout::offset(i) || (GLenum)members[i].second != T::Layout::glType(i))
+			{
+				printf("ERROR::UNIFORM_BUFFER::%s::MEMBER %u at offset %d in GLSL, %u in C++\n", name.c_str(), (unsigned int)i,
+					members[i].first, (unsigned int)T::Layout::offset(i));
+				valid = false;
+			}
+		}
+		return valid;
+	}
+
+private:
+	std::string name;
+	unsigned int ringSize;
+	unsigned int slot;
+	size_t stride;			// Slot size, rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+};
+
+#endif
@@ -0,0 +1,361 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include <glad/glad.h>
+
+#include "PixelUnpackRing.h"
+#include "Timer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/* Spreads GPU uploads over frames. Requests are queued, then update() sends as many chunks as fit in the frame budget,
+   highest priority first and in request order between equal priorities. Textures are split into bands of rows
+   and buffers into byte ranges, so one large asset never takes a whole frame.
+   A texture being streamed shows the bands already uploaded until its last chunk lands. */
+class UploadScheduler
+{
+public:
+	/* Called on the GL thread once the last chunk of a request has been issued, e.g. to free the pixels or generate mipmaps */
+	typedef std::function<void()> Done;
+
+	unsigned long long bytes;		// Bytes uploaded so far
+	unsigned int chunks;			// Chunks issued so far
+	unsigned int completed;			// Requests fully uploaded
+	unsigned int deferredFrames;	// update() calls that stopped on the budget with work left
+
+	/* A budget of 0 bytes or 0 ms means no limit on that axis. chunkBytes is the size uploads are split into. */
+	explicit UploadScheduler(PixelUnpackRing& staging, size_t budgetBytes = 8 << 20, double budgetMs = 2.0, size_t chunkBytes = 512 << 10)
+		: bytes(0), chunks(0), completed(0), deferredFrames(0), staging(staging),
+		budgetBytes(budgetBytes), budgetMs(budgetMs), chunkBytes(chunkBytes > 0 ? chunkBytes : 1), sequence(0)
+	{
+	}
+
+	UploadScheduler(const UploadScheduler&) = delete;
+	UploadScheduler& operator=(const UploadScheduler&) = delete;
+
+	void setBudget(size_t bytesPerFrame, double msPerFrame)
+	{
+		budgetBytes = bytesPerFrame;
+		budgetMs = msPerFrame;
+	}
+
+	/* Queue width x height pixels for a level of a GL_TEXTURE_2D. Rows are tightly packed; pixels must stay valid until done runs.
+	   With an internalFormat the level storage is allocated right before the first band, so the texture keeps
+	   its previous content until streaming actually starts. With 0 the storage must already exist.
+	   flip uploads the rows bottom up, reversed while they are copied into the staging ring. */
+	void texture(GLuint name, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type,
+		size_t bytesPerPixel, const void* pixels, float priority = 0.0f, Done done = Done(), bool flip = false)
+	{
+		Job job = makeJob(priority, done);
+		job.target = GL_TEXTURE_2D;
+		job.name = name;
+		job.level = level;
+		job.internalFormat = internalFormat;
+		job.width = width;
+		job.height = height;
+		job.format = format;
+		job.type = type;
+		job.data = (const unsigned char*)pixels;
+		job.rowBytes = (size_t)width * bytesPerPixel;
+		job.rowHeight = 1;
+		job.size = job.rowBytes * height;
+		job.flip = flip;
+		push(job);
+	}
+
+	/* Queue width x height pixels for one layer of a level of a GL_TEXTURE_2D_ARRAY, whose storage must already exist */
+	void textureLayer(GLuint name, GLint level, GLint layer, GLsizei width, GLsizei height, GLenum format, GLenum type,
+		size_t bytesPerPixel, const void* pixels, float priority = 0.0f, Done done = Done())
+	{
+		Job job = makeJob(priority, done);
+		job.target = GL_TEXTURE_2D_ARRAY;
+		job.name = name;
+		job.level = level;
+		job.layer = layer;
+		job.width = width;
+		job.height = height;
+		job.format = format;
+		job.type = type;
+		job.data = (const unsigned char*)pixels;
+		job.rowBytes = (size_t)width * bytesPerPixel;
+		job.rowHeight = 1;
+		job.size = job.rowBytes * height;
+		push(job);
+	}
+
+	/* Queue a block compressed level, 4x4 texel blocks of blockBytes each in row order, e.g. from BlockCompressor.
+	   Bands are whole rows of blocks. The level is always allocated before the first band, in internalFormat. */
+	void compressedTexture(GLuint name, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+		size_t blockBytes, const void* blocks, float priority = 0.0f, Done done = Done())
+	{
+		Job job = makeJob(priority, done);
+		job.target = GL_TEXTURE_2D;
+		job.name = name;
+		job.level = level;
+		job.internalFormat = internalFormat;
+		job.compressed = true;
+		job.width = width;
+		job.height = height;
+		job.data = (const unsigned char*)blocks;
+		job.rowBytes = (size_t)((width + 3) / 4) * blockBytes;
+		job.rowHeight = 4;
+		job.size = job.rowBytes * ((height + 3) / 4);
+		push(job);
+	}
+
+	/* Queue size bytes for a buffer object at offset, e.g. a GL_ARRAY_BUFFER whose storage is already allocated */
+	void buffer(GLenum target, GLuint name, size_t offset, const void* data, size_t size, float priority = 0.0f, Done done = Done())
+	{
+		Job job = makeJob(priority, done);
+		job.target = target;
+		job.name = name;
+		job.offset = offset;
+		job.data = (const unsigned char*)data;
+		job.size = size;
+		push(job);
+	}
+
+	/* Raise or lower every queued request of an object, e.g. once it becomes visible */
+	void setPriority(GLuint name, float priority)
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			if (jobs[i].name == name)
+			{
+				jobs[i].priority = priority;
+			}
+		}
+		std::make_heap(jobs.begin(), jobs.end(), Job::Before());
+	}
+
+	/* Drop every queued request of an object without running their done callbacks, e.g. when it is deleted */
+	void cancel(GLuint name)
+	{
+		jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [name](const Job& job) { return job.name == name; }), jobs.end());
+		std::make_heap(jobs.begin(), jobs.end(), Job::Before());
+	}
+
+	/* Call once per frame on the GL thread. Always issues at least one chunk so work keeps moving, then stops at
+	   the byte or time budget, or when the staging ring has no free slot. Returns the bytes uploaded. */
+	size_t update()
+	{
+		Timer timer;
+		size_t frameBytes = 0;
+		bool unpackAligned = false;
+
+		while (!jobs.empty())
+		{
+			if (frameBytes > 0 && ((budgetBytes > 0 && frameBytes >= budgetBytes) || (budgetMs > 0.0 && timer.elapsedMs() >= budgetMs)))
+			{
+				deferredFrames++;
+				break;
+			}
+
+			Job& job = jobs.front();
+			size_t sent = 0;
+			if (job.target == GL_TEXTURE_2D || job.target == GL_TEXTURE_2D_ARRAY)
+			{
+				if (!unpackAligned)
+				{
+					glPixelStorei(GL_UNPACK_ALIGNMENT, 1);		// Rows are tightly packed
+					unpackAligned = true;
+				}
+				sent = sendRows(job);
+			}
+			else
+			{
+				sent = sendBytes(job);
+			}
+			if (sent == 0)
+			{
+				break;		// Staging ring is full, continue next frame
+			}
+
+			frameBytes += sent;
+			bytes += sent;
+			chunks++;
+
+			if (job.progress >= job.size)
+			{
+				Done done = job.done;
+				std::pop_heap(jobs.begin(), jobs.end(), Job::Before());
+				jobs.pop_back();
+				completed++;
+				if (done)
+				{
+					done();
+				}
+			}
+		}
+
+		if (unpackAligned)
+		{
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+		return frameBytes;
+	}
+
+	/* Requests not fully uploaded yet */
+	size_t pending() const
+	{
+		return jobs.size();
+	}
+
+	/* Whether an object still has requests queued, e.g. to wait for a texture to be fully resident */
+	bool isQueued(GLuint name) const
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			if (jobs[i].name == name)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	PixelUnpackRing& getStaging()
+	{
+		return staging;
+	}
+
+private:
+	struct Job
+	{
+		float priority;
+		uint64_t sequence;		// Request order, breaks ties between equal priorities
+		GLenum target;
+		GLuint name;
+		GLint level;
+		GLint layer;			// Of a GL_TEXTURE_2D_ARRAY
+		GLint internalFormat;	// Allocate the level before the first band if not 0
+		bool compressed;		// Block compressed, format and type are unused
+		bool flip;				// Rows go bottom up, GL_TEXTURE_2D only
+		GLsizei width;
+		GLsizei height;
+		GLenum format;
+		GLenum type;
+		size_t rowBytes;
+		GLint rowHeight;		// Texel rows per row of data, 4 for blocks
+		size_t offset;
+		const unsigned char* data;
+		size_t size;
+		size_t progress;		// Bytes already issued
+		Done done;
+
+		/* Heap order : the top is the job to upload first */
+		struct Before
+		{
+			bool operator()(const Job& a, const Job& b) const
+			{
+				if (a.priority != b.priority)
+				{
+					return a.priority < b.priority;
+				}
+				return a.sequence > b.sequence;
+			}
+		};
+	};
+
+	PixelUnpackRing& staging;
+	size_t budgetBytes;
+	double budgetMs;
+	size_t chunkBytes;
+	uint64_t sequence;
+	std::vector<Job> jobs;		// Heap ordered by Job::Before
+
+	Job makeJob(float priority, const Done& done)
+	{
+		Job job = Job();
+		job.priority = priority;
+		job.sequence = sequence++;
+		job.done = done;
+		return job;
+	}
+
+	void push(const Job& job)
+	{
+		if (job.size == 0)
+		{
+			completed++;
+			if (job.done)
+			{
+				job.done();
+			}
+			return;
+		}
+		jobs.push_back(job);
+		std::push_heap(jobs.begin(), jobs.end(), Job::Before());
+	}
+
+	/* Next band of rows of a texture job, as many whole rows as fit in a chunk */
+	size_t sendRows(Job& job)
+	{
+		GLint dataRows = (GLint)(job.size / job.rowBytes);
+		GLint firstRow = (GLint)(job.progress / job.rowBytes);
+		GLint rows = (GLint)std::max((size_t)1, chunkBytes / job.rowBytes);
+		rows = std::min(rows, dataRows - firstRow);
+		if (job.compressed && job.height % 4 != 0)
+		{
+			rows = dataRows;		// S3TC only accepts a partial block row if the update covers the whole level
+		}
+		size_t size = (size_t)rows * job.rowBytes;
+
+		if (!staging.hasFreeSlot())
+		{
+			return 0;		// Checked before allocating so a refused band doesn't wipe the texture content
+		}
+
+		glBindTexture(job.target, job.name);
+		GLint y = firstRow * job.rowHeight;
+		GLsizei height = std::min(rows * job.rowHeight, job.height - y);
+		bool staged;
+		if (job.compressed)
+		{
+			if (job.progress == 0)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, job.level, (GLenum)job.internalFormat, job.width, job.height, 0, (GLsizei)job.size, NULL);
+			}
+			staged = staging.uploadCompressed(GL_TEXTURE_2D, job.level, 0, y, job.width, height, (GLenum)job.internalFormat, job.data + job.progress, size);
+		}
+		else if (job.target == GL_TEXTURE_2D_ARRAY)
+		{
+			staged = staging.uploadLayer(job.target, job.level, 0, y, job.layer, job.width, height, job.format, job.type, job.data + job.progress, size);
+		}
+		else
+		{
+			if (job.progress == 0 && job.internalFormat != 0)
+			{
+				glTexImage2D(GL_TEXTURE_2D, job.level, job.internalFormat, job.width, job.height, 0, job.format, job.type, NULL);
+			}
+			if (job.flip)
+			{
+				y = job.height - y - height;		// The band lands mirrored, its rows reversed by the staging copy
+			}
+			staged = staging.upload(GL_TEXTURE_2D, job.level, 0, y, job.width, height, job.format, job.type, job.data + job.progress, size,
+				job.flip ? job.rowBytes : 0);
+		}
+		if (!staged)
+		{
+			return 0;
+		}
+		job.progress += size;
+		return size;
+	}
+
+	/* Next byte range of a buffer job, written directly since the driver already pipelines glBufferSubData */
+	size_t sendBytes(Job& job)
+	{
+		size_t size = std::min(chunkBytes, job.size - job.progress);
+		glBindBuffer(job.target, job.name);
+		glBufferSubData(job.target, (GLintptr)(job.offset + job.progress), (GLsizeiptr)size, job.data + job.progress);
+		job.progress += size;
+		return size;
+	}
+};
+
+#endif
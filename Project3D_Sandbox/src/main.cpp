@@ -1,12 +1,36 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "GLExtensions.h"
+#include "ProgramBinaryCache.h"
+#include "Shader.h"
+#include "ShaderLibrary.h"
+#include "ShaderVariants.h"
+#include "ShaderWatcher.h"
+#include "UniformBuffer.h"
+#include "FrameData.h"
+#include "Benchmark.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureCooker.h"
+#include "TexturePack.h"
+#include "TextureStreamer.h"
+#include "UploadScheduler.h"
+#include "PixelUnpackRing.h"
+#include "SamplerCache.h"
+#include "FrameStats.h"
+#include "Timer.h"
+
+/* After the headers that use stb_image, so the implementation is compiled exactly once. The JPEG and PNG decoders call into its internals. */
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-
-#include "Shader.h"
+#define JPEG_DECODER_IMPLEMENTATION
+#include "JpegDecoder.h"
+#define PNG_DECODER_IMPLEMENTATION
+#include "PngDecoder.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <cmath>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -16,8 +40,17 @@ const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 float opacity = 0.5f;
 
-int main()
+int main(int argc, char** argv)
 {
+	Timer startupTimer;
+
+	/* Cook mode : "--cook [sourceDirectory] [pack] [--compress]" bakes the images into a texture pack and exits, no window needed */
+	if (argc > 1 && strcmp(argv[1], "--cook") == 0)
+	{
+		bool compress = argc > 4 && strcmp(argv[4], "--compress") == 0;
+		return TextureCooker::cook(argc > 2 ? argv[2] : "./Assets/img", argc > 3 ? argv[3] : "./Assets/textures.pack", compress) ? 0 : -1;
+	}
+
 	/* ======================================== Initialization =========================================================== */
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -45,10 +78,35 @@ int main()
 		printf("Failed to initialize GLAD");
 		return -1;
 	}
+	GLExtensions::load((GLADloadproc)glfwGetProcAddress);
 	/* ==================================================================================================================== */
 
 
-	Shader ourShader("./Shaders/texture.vs", "./Shaders/texture.fs");
+	/* Benchmark mode : "--bench <name> [input]" runs a benchmark with the context and exits */
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+	{
+		bool found = Benchmark::run(argv[2], argc > 3 ? argv[3] : nullptr);
+		glfwTerminate();
+		return found ? 0 : -1;
+	}
+
+	/* Hot reload : edited files under Shaders/ are recompiled at the start of the next frame */
+	ShaderWatcher shaderWatcher("./Shaders");
+
+	/* Variants of texture.fs, compiled on first use and loaded from the binary cache when possible.
+	   NO_TEXTURE2 skips the second sample while it is fully transparent. */
+	ProgramBinaryCache programCache;
+	std::vector<std::string> textureFeatures(1, "NO_TEXTURE2");
+	ShaderVariants textureShaders("./Shaders/texture.vs", "./Shaders/texture.fs", textureFeatures, &programCache, &shaderWatcher,
+		[](Shader& shader)
+		{
+			shader.setInt("texture1", 0);
+			shader.setInt("texture2", 1);
+		});
+	const uint64_t NO_TEXTURE2 = textureShaders.bit("NO_TEXTURE2");
+
+	Shader& baseShader = textureShaders.get(0);
+	printf("Shader texture built in %.2f ms (%s)\n", baseShader.buildMs, baseShader.fromBinaryCache ? "binary cache" : "compiled");
 
 	/* Rectangle */
 	float vertices[] = {
@@ -90,65 +148,70 @@ int main()
 
 
 	/* ======================================== Textures ================================================================ */
-	/* Load the generate texture */
-	int width, height, nrChannels;
-	unsigned int texture1, texture2;
+	/* Decoded on worker threads, the textures hold a placeholder until their upload is scheduled.
+	   Uploads go through a staging ring, at most 2 ms or 8 MB per frame. */
+	PixelUnpackRing textureStaging(8, 512 << 10);
+	UploadScheduler uploads(textureStaging, 8 << 20, 2.0, 512 << 10);
+	TextureLoader textureLoader(uploads);
 
-	// First texture
-	glGenTextures(1, &texture1);					// Generate texture1 and get handle
-	glBindTexture(GL_TEXTURE_2D, texture1);			// Rendering active texture
-	/* Set the texture wrapping/filtering options (on the currently bound texture object) */
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	unsigned char* data = stbi_load("./Assets/img/container.jpg", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		printf("Failed to load texture");
-	}
-	stbi_image_free(data);
+	/* Cooked textures skip decoding entirely, images missing from the pack (or no pack at all) are decoded as before */
+	TexturePack texturePack;
+	texturePack.open("./Assets/textures.pack");
 
+	// First texture
+	TextureOptions texture1Options;
+	texture1Options.wrap = GL_REPEAT;
+	texture1Options.minFilter = GL_LINEAR;
+	texture1Options.magFilter = GL_LINEAR;
+	texture1Options.compression = TEXTURE_COMPRESSION_BC1_BC3;		// Stays uncompressed without S3TC
+	texture1Options.mipOptions = TextureCooker::mipOptions();		// Same levels whether the pack or the loader builds them
+	/* Large packed images start with their levels up to 128 texels, finer ones stream in as the quad needs them */
+	TextureStreamer textureStreamer(texturePack, uploads, 128);
+	TextureCache textureCache(textureLoader, uploads, &texturePack);
+	textureCache.setBudget(256 << 20, 4096);		// Fits small VRAM : unused textures are evicted, then top mips dropped
+	textureCache.setStreamer(&textureStreamer);
+	TextureHandle texture1 = textureCache.load("./Assets/img/container.jpg", texture1Options);
 
 	// Second texture
-	glGenTextures(1, &texture2);
-	glBindTexture(GL_TEXTURE_2D, texture2);
-	/* Set the texture wrapping/filtering options (on the currently bound texture object) */
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	stbi_set_flip_vertically_on_load(true);		// Flipping image verticaly to invert axis Y
-
-	data = stbi_load("./Assets/img/awesomeface.png", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		printf("Failed to load texture");
-	}
-	stbi_image_free(data);
-
-	ourShader.use();
-	ourShader.setInt("texture1", 0);
-	ourShader.setInt("texture2", 1);
-	ourShader.setFloat("opacity", 2);
+	TextureOptions texture2Options;
+	texture2Options.wrap = GL_CLAMP_TO_EDGE;
+	texture2Options.minFilter = GL_NEAREST;
+	texture2Options.magFilter = GL_NEAREST;
+	texture2Options.flip = true;		// Flipping image verticaly to invert axis Y, done while converting or staging the rows
+	texture2Options.compression = TEXTURE_COMPRESSION_BC1_BC3;
+	texture2Options.mipOptions = TextureCooker::mipOptions();
+	TextureHandle texture2 = textureCache.load("./Assets/img/awesomeface.png", texture2Options);
+
+	/* Wrap and filters are bound per unit, so both images could also be sampled another way without a second copy */
+	SamplerCache samplers;
+	SamplerState sampler1(texture1Options);
+	SamplerState sampler2(texture2Options);
+
+	Uniform<float> opacityUniform = baseShader.uniform<float>("opacity");
+
+	/* Per-frame block, uploaded once per frame and shared by every program */
+	UniformBuffer<FrameData> frameBuffer("FrameData");
+	frameBuffer.validate(baseShader);
+	FrameData frameData = FrameData();
+	frameData.tint.x = frameData.tint.y = frameData.tint.z = frameData.tint.w = 1.0f;
 	/* ====================================== End Textures ============================================================== */
 
+	printf("Startup : %.2f ms\n", startupTimer.elapsedMs());
+
 
 	/* ======================================== Render Loop ============================================================== */
+	FrameStats frameStats;
+	Timer frameTimer;
 	while (!glfwWindowShouldClose(window))
 	{
+		frameStats.add(frameTimer.elapsedMs());		// Previous frame, swap included
+		frameTimer.reset();
+
+		shaderWatcher.poll();		// Swap in shaders edited since the last frame
+		textureLoader.update();		// Queue the images decoded since the last frame
+		uploads.update();			// Stream pending uploads within the frame budget
+		textureStreamer.update();	// Request the mip levels last frame's quad size called for
+		textureCache.update();		// Account the textures done loading, shrink to the memory budget
 		processInput(window);		// Input
 
 		/* Control opacity limits */
@@ -161,17 +224,39 @@ int main()
 			opacity = 0.0f;
 		}
 
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		frameData.resolution.x = (float)framebufferWidth;
+		frameData.resolution.y = (float)framebufferHeight;
+		frameData.time = (float)glfwGetTime();
+		frameBuffer.update(frameData);
+
+		/* The quad spans 1 of the 2 NDC units on each axis, so half the framebuffer */
+		textureStreamer.request(texture1.get(), framebufferWidth * 0.5f, framebufferHeight * 0.5f);
+		textureStreamer.request(texture2.get(), framebufferWidth * 0.5f, framebufferHeight * 0.5f);
+
 		/* Rendering commands here */
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
+		glBindTexture(GL_TEXTURE_2D, texture1.get());
+		sampler1.minLod = textureStreamer.minLod(texture1.get());		// Fades in the levels streamed since
+		samplers.bind(0, sampler1);
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture2);
+		glBindTexture(GL_TEXTURE_2D, texture2.get());
+		sampler2.minLod = textureStreamer.minLod(texture2.get());
+		samplers.bind(1, sampler2);
 
+		bool noTexture2 = opacity <= 0.001f;
+		Shader& ourShader = textureShaders.get(noTexture2 ? NO_TEXTURE2 : 0);
 		ourShader.use();
+		if (!noTexture2)
+		{
+			ourShader.set(opacityUniform, opacity);		// Handle resolved on the base variant
+		}
 		glBindVertexArray(VAO);
+		ourShader.flush();		// Uploads only the uniforms that changed since the last draw
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);				// Drawing polygons in wireframe mode
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);		// Drawing rectangle
 		//glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -181,9 +266,25 @@ int main()
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
+	printf("Uniform uploads : %llu, avoided : %llu\n", baseShader.uniformStats.uploads, baseShader.uniformStats.avoided);
+	printf("Textures : %u uploaded, %u failed, decode %.2f ms on workers, %u JPEGs split at restart markers\n", textureLoader.uploaded,
+		textureLoader.failed, textureLoader.decodeMs, textureLoader.parallelJpegs);
+	printf("Texture cache : %u hits, %u misses, %u freed\n", textureCache.hits, textureCache.misses, textureCache.freed);
+	printf("Texture memory : %.2f MB used, %.2f MB high water, %u evicted, %u levels dropped\n", textureCache.used / (1024.0 * 1024.0),
+		textureCache.highWater / (1024.0 * 1024.0), textureCache.evicted, textureCache.droppedLevels);
+	printf("Samplers : %u created, %u binds, %u redundant binds skipped\n", samplers.created, samplers.binds, samplers.skipped);
+	printf("Texture streaming : %u levels streamed in, %u dropped\n", textureStreamer.streamedLevels, textureStreamer.droppedLevels);
+	printf("Uploads : %.2f MB in %u chunks, %u frames over budget, %u staging stalls\n",
+		uploads.bytes / (1024.0 * 1024.0), uploads.chunks, uploads.deferredFrames, textureStaging.stalls);
+	printf("Frame time : p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", frameStats.percentile(50.0), frameStats.percentile(99.0), frameStats.max());
+
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
+	texture1.reset();		// Textures go while the context is still there
+	texture2.reset();
+	textureCache.purge();
+	samplers.clear();
 	/* ==================================================================================================================== */
 
 
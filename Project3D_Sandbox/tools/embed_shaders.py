@@ -0,0 +1,78 @@
+"""Embed every file of the Shaders/ directory into a C++ header.
+
+Release builds define SANDBOX_EMBED_SHADERS and include the generated header, so shaders are read
+from the executable instead of the disk. Run as a pre-build step :
+
+    python tools/embed_shaders.py Shaders src/EmbeddedShaders.h
+"""
+
+import os
+import sys
+
+
+def main(argv):
+    if len(argv) != 3:
+        print("usage: embed_shaders.py <shader directory> <output header>")
+        return 1
+
+    shader_dir = argv[1]
+    output = argv[2]
+    prefix = os.path.basename(os.path.normpath(shader_dir))
+
+    entries = []
+    for root, _, names in os.walk(shader_dir):
+        for name in sorted(names):
+            path = os.path.join(root, name)
+            key = prefix + "/" + os.path.relpath(path, shader_dir).replace("\\", "/")
+            with open(path, "rb") as f:
+                entries.append((key, f.read()))
+    entries.sort()
+
+    lines = [
+        "// Generated by tools/embed_shaders.py, do not edit",
+        "#ifndef EMBEDDED_SHADERS_H",
+        "#define EMBEDDED_SHADERS_H",
+        "",
+        "struct EmbeddedShader",
+        "{",
+        "\tconst char* path;\t\t\t\t// Relative to the project directory, e.g. \"Shaders/texture.fs\"",
+        "\tconst unsigned char* data;",
+        "\tunsigned int size;",
+        "};",
+        "",
+    ]
+    for index, (key, data) in enumerate(entries):
+        lines.append("// %s" % key)
+        lines.append("static const unsigned char embeddedShader%d[] =" % index)
+        lines.append("{")
+        # Trailing zero so the data is also usable as a C string
+        payload = data + b"\0"
+        for start in range(0, len(payload), 16):
+            lines.append("\t" + ", ".join("0x%02x" % b for b in payload[start:start + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+
+    lines.append("static const EmbeddedShader embeddedShaders[] =")
+    lines.append("{")
+    for index, (key, data) in enumerate(entries):
+        lines.append("\t{ \"%s\", embeddedShader%d, %du }," % (key, index, len(data)))
+    if not entries:
+        lines.append("\t{ \"\", nullptr, 0u },")
+    lines.append("};")
+    lines.append("static const unsigned int embeddedShaderCount = %du;" % len(entries))
+    lines.append("")
+    lines.append("#endif")
+    content = "\n".join(lines) + "\n"
+
+    # Keep the timestamp when nothing changed so the project isn't rebuilt for nothing
+    if os.path.exists(output):
+        with open(output, "r") as f:
+            if f.read() == content:
+                return 0
+    with open(output, "w") as f:
+        f.write(content)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))